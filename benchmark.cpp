@@ -0,0 +1,252 @@
+/*
+  Copyright (c) 2017 Genome Research Ltd.
+
+  Author: Jouni Siren <jouni.siren@iki.fi>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+
+#include <random>
+#include <unistd.h>
+
+#include "cached_gbwt.h"
+#include "hybrid_gbwt.h"
+
+using namespace gbwt;
+
+//------------------------------------------------------------------------------
+
+const size_type DEFAULT_QUERIES = MILLION;
+const size_type RANDOM_SEED     = 0xDEADBEEF;
+
+void printUsage(int exit_code = EXIT_SUCCESS);
+
+std::vector<edge_type> randomPositions(const GBWT& gbwt, size_type n);
+
+template<class GBWTType>
+void benchmarkLF(const GBWTType& gbwt, const std::vector<edge_type>& queries, const std::string& header);
+
+void benchmarkLocate(const GBWT& gbwt, const std::vector<edge_type>& queries, const std::string& header);
+
+size_type hugePageMemory();
+
+//------------------------------------------------------------------------------
+
+int
+main(int argc, char** argv)
+{
+  if(argc < 2) { printUsage(); }
+
+  size_type query_count = DEFAULT_QUERIES, hybrid_budget = HybridGBWT::DEFAULT_BUDGET;
+  size_type prefault_threads = omp_get_max_threads();
+  int c = 0;
+  while((c = getopt(argc, argv, "b:p:q:")) != -1)
+  {
+    switch(c)
+    {
+    case 'b':
+      hybrid_budget = std::stoul(optarg) * MEGABYTE; break;
+    case 'p':
+      prefault_threads = std::stoul(optarg); break;
+    case 'q':
+      query_count = std::stoul(optarg); break;
+    case '?':
+      std::exit(EXIT_FAILURE);
+    default:
+      std::exit(EXIT_FAILURE);
+    }
+  }
+  if(optind >= argc) { printUsage(EXIT_FAILURE); }
+  std::string base_name = argv[optind];
+
+  std::cout << "GBWT benchmark" << std::endl;
+  std::cout << std::endl;
+
+  printHeader("Base name"); std::cout << base_name << std::endl;
+  printHeader("Queries"); std::cout << query_count << std::endl;
+  printHeader("Hybrid budget"); std::cout << inMegabytes(hybrid_budget) << " MB" << std::endl;
+  printHeader("Prefault threads"); std::cout << prefault_threads << std::endl;
+  std::cout << std::endl;
+
+  // Load the index without the optional structures; they are built separately below.
+  GBWT index;
+  Acceleration::set(Acceleration::NEVER);
+  double start = readTimer();
+  sdsl::load_from_file(index, base_name + GBWT::EXTENSION);
+  double load_seconds = readTimer() - start;
+  printStatistics(index, base_name);
+
+  std::vector<edge_type> queries = randomPositions(index, query_count);
+  if(queries.empty())
+  {
+    std::cerr << "benchmark: The index is empty" << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+
+  benchmarkLF(index, queries, "LF/select");
+  index.bwt.buildDirectory();
+  benchmarkLF(index, queries, "LF/directory");
+  {
+    CachedGBWT cached(index);
+    benchmarkLF(cached, queries, "LF/cached");
+    printHeader("Cached records"); std::cout << cached.cachedRecords() << " ("
+                                              << inMegabytes(cached.cachedBytes()) << " MB)" << std::endl;
+  }
+  {
+    HybridGBWT hybrid(hybrid_budget);
+    sdsl::load_from_file(hybrid, base_name + HybridGBWT::EXTENSION);
+    benchmarkLF(hybrid, queries, "LF/hybrid");
+    printHeader("Decoded records"); std::cout << hybrid.decodedRecords() << " ("
+                                               << inMegabytes(hybrid.decodedBytes()) << " MB)" << std::endl;
+  }
+  std::cout << std::endl;
+
+  index.bwt.clearDirectory();
+  benchmarkLocate(index, queries, "select");
+  index.bwt.buildDirectory();
+  benchmarkLocate(index, queries, "directory");
+  index.da_samples.buildFused();
+  benchmarkLocate(index, queries, "fused");
+  std::cout << std::endl;
+
+  // Reload the index with all optional structures in huge pages.
+  {
+    GBWT huge;
+    Acceleration::set(Acceleration::ALWAYS);
+    HugePages::set(true, prefault_threads);
+    size_type huge_pages_before = hugePageMemory();
+    start = readTimer();
+    sdsl::load_from_file(huge, base_name + GBWT::EXTENSION);
+    double huge_seconds = readTimer() - start;
+    HugePages::set(false);
+    printHeader("Load/normal"); std::cout << load_seconds << " seconds" << std::endl;
+    printHeader("Load/huge pages"); std::cout << huge_seconds << " seconds" << std::endl;
+    printHeader("Huge pages"); std::cout << inMegabytes(hugePageMemory() - std::min(huge_pages_before, hugePageMemory()))
+                                         << " MB" << std::endl;
+    std::cout << std::endl;
+
+    benchmarkLF(index, queries, "LF/normal");
+    benchmarkLF(huge, queries, "LF/huge pages");
+    benchmarkLocate(index, queries, "normal");
+    benchmarkLocate(huge, queries, "huge");
+    std::cout << std::endl;
+  }
+
+  std::cout << "Memory usage " << inGigabytes(memoryUsage()) << " GB" << std::endl;
+  std::cout << std::endl;
+
+  return 0;
+}
+
+//------------------------------------------------------------------------------
+
+void
+printUsage(int exit_code)
+{
+  std::cerr << "Usage: benchmark [options] base_name" << std::endl;
+  std::cerr << "  -b N  Use N MB for decoded records in the hybrid GBWT (default "
+            << (HybridGBWT::DEFAULT_BUDGET / MEGABYTE) << ")" << std::endl;
+  std::cerr << "  -p N  Prefault huge page memory using N threads (default " << omp_get_max_threads() << ")" << std::endl;
+  std::cerr << "  -q N  Use N random queries (default " << DEFAULT_QUERIES << ")" << std::endl;
+  std::cerr << std::endl;
+
+  std::exit(exit_code);
+}
+
+// Positions are sampled uniformly from the BWT, excluding the endmarker.
+std::vector<edge_type>
+randomPositions(const GBWT& gbwt, size_type n)
+{
+  std::vector<size_type> cumulative(gbwt.effective() + 1, 0);
+  for(GBWT::comp_type comp = 1; comp < gbwt.effective(); comp++)
+  {
+    cumulative[comp + 1] = cumulative[comp] + gbwt.count(gbwt.toNode(comp));
+  }
+  std::vector<edge_type> result;
+  if(cumulative.back() == 0) { return result; }
+
+  std::mt19937_64 rng(RANDOM_SEED);
+  result.reserve(n);
+  for(size_type i = 0; i < n; i++)
+  {
+    size_type offset = rng() % cumulative.back();
+    GBWT::comp_type comp = std::upper_bound(cumulative.begin(), cumulative.end(), offset) - cumulative.begin() - 1;
+    result.push_back(edge_type(gbwt.toNode(comp), offset - cumulative[comp]));
+  }
+  return result;
+}
+
+template<class GBWTType>
+void
+benchmarkLF(const GBWTType& gbwt, const std::vector<edge_type>& queries, const std::string& header)
+{
+  double start = readTimer();
+  size_type checksum = 0;
+  for(edge_type query : queries)
+  {
+    edge_type result = gbwt.LF(query);
+    checksum += result.first + result.second;
+  }
+  double seconds = readTimer() - start;
+  printTime(header, queries.size(), seconds);
+  if(checksum == 0) { std::cout << "checksum " << checksum << std::endl; } // Do not optimize away.
+}
+
+void
+benchmarkLocate(const GBWT& gbwt, const std::vector<edge_type>& queries, const std::string& header)
+{
+  double start = readTimer();
+  size_type checksum = 0;
+  for(edge_type query : queries) { checksum += gbwt.locate(query); }
+  double seconds = readTimer() - start;
+  printTime("Locate/" + header, queries.size(), seconds);
+
+  start = readTimer();
+  std::vector<size_type> results = gbwt.locate(queries);
+  seconds = readTimer() - start;
+  printTime("Batch/" + header, queries.size(), seconds);
+
+  size_type batch_checksum = 0;
+  for(size_type result : results) { batch_checksum += result; }
+  if(batch_checksum != checksum)
+  {
+    std::cerr << "benchmark: Batch locate returned different results" << std::endl;
+  }
+}
+
+//------------------------------------------------------------------------------
+
+// Anonymous memory in transparent huge pages according to the kernel, or 0 if unknown.
+size_type
+hugePageMemory()
+{
+  std::ifstream smaps("/proc/self/smaps_rollup");
+  std::string line;
+  while(std::getline(smaps, line))
+  {
+    if(line.compare(0, 14, "AnonHugePages:") == 0)
+    {
+      return std::stoul(line.substr(14)) * 1024;
+    }
+  }
+  return 0;
+}
+
+//------------------------------------------------------------------------------
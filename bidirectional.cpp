@@ -0,0 +1,242 @@
+/*
+  Copyright (c) 2017 Genome Research Ltd.
+
+  Author: Jouni Siren <jouni.siren@iki.fi>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+
+#include "bidirectional.h"
+
+namespace gbwt
+{
+
+//------------------------------------------------------------------------------
+
+std::ostream&
+operator<<(std::ostream& out, const BidirectionalState& state)
+{
+  return out << "(" << state.from << " .. " << state.to
+             << ", forward " << state.forward << ", backward " << state.backward << ")";
+}
+
+//------------------------------------------------------------------------------
+
+const std::string BidirectionalGBWT::EXTENSION = ".bgbwt";
+
+BidirectionalGBWT::BidirectionalGBWT()
+{
+}
+
+BidirectionalGBWT::BidirectionalGBWT(const BidirectionalGBWT& source)
+{
+  this->copy(source);
+}
+
+BidirectionalGBWT::BidirectionalGBWT(BidirectionalGBWT&& source)
+{
+  *this = std::move(source);
+}
+
+BidirectionalGBWT::~BidirectionalGBWT()
+{
+}
+
+void
+BidirectionalGBWT::swap(BidirectionalGBWT& another)
+{
+  if(this != &another)
+  {
+    this->forward.swap(another.forward);
+    this->backward.swap(another.backward);
+  }
+}
+
+BidirectionalGBWT&
+BidirectionalGBWT::operator=(const BidirectionalGBWT& source)
+{
+  if(this != &source) { this->copy(source); }
+  return *this;
+}
+
+BidirectionalGBWT&
+BidirectionalGBWT::operator=(BidirectionalGBWT&& source)
+{
+  if(this != &source)
+  {
+    this->forward = std::move(source.forward);
+    this->backward = std::move(source.backward);
+  }
+  return *this;
+}
+
+size_type
+BidirectionalGBWT::serialize(std::ostream& out, sdsl::structure_tree_node* v, std::string name) const
+{
+  sdsl::structure_tree_node* child = sdsl::structure_tree::add_child(v, name, sdsl::util::class_name(*this));
+  size_type written_bytes = 0;
+
+  written_bytes += this->forward.serialize(out, child, "forward");
+  written_bytes += this->backward.serialize(out, child, "backward");
+
+  sdsl::structure_tree::add_size(child, written_bytes);
+  return written_bytes;
+}
+
+void
+BidirectionalGBWT::load(std::istream& in)
+{
+  this->forward.load(in);
+  this->backward.load(in);
+  if(this->forward.sequences() != this->backward.sequences() || this->forward.size() != this->backward.size())
+  {
+    std::cerr << "BidirectionalGBWT::load(): The forward and backward indexes do not match" << std::endl;
+  }
+}
+
+void
+BidirectionalGBWT::copy(const BidirectionalGBWT& source)
+{
+  this->forward = source.forward;
+  this->backward = source.backward;
+}
+
+//------------------------------------------------------------------------------
+
+void
+reverseSequences(const text_type& text, text_type& result)
+{
+  result = text_type(text.size(), 0, text.width());
+  for(size_type start = 0, i = 0; i < text.size(); i++)
+  {
+    if(text[i] != ENDMARKER) { continue; }
+    for(size_type j = start; j < i; j++) { result[j] = text[i - 1 - (j - start)]; }
+    result[i] = ENDMARKER;
+    start = i + 1;
+  }
+}
+
+void
+BidirectionalGBWT::insert(const text_type& text)
+{
+  this->forward.insert(text);
+
+  text_type reversed;
+  reverseSequences(text, reversed);
+  this->backward.insert(reversed);
+}
+
+void
+BidirectionalGBWT::insert(text_buffer_type& text, size_type batch_size)
+{
+  this->forward.insert(text, batch_size);
+
+  // Write the reverse sequences to a temporary file.
+  std::string temp_name = TempFile::getName("bidirectional");
+  {
+    text_buffer_type reversed(temp_name, std::ios::out, MEGABYTE, text.width());
+    std::vector<node_type> buffer;
+    for(size_type i = 0; i < text.size(); i++)
+    {
+      if(text[i] == ENDMARKER)
+      {
+        for(auto iter = buffer.rbegin(); iter != buffer.rend(); ++iter) { reversed.push_back(*iter); }
+        reversed.push_back(ENDMARKER);
+        buffer.clear();
+      }
+      else { buffer.push_back(text[i]); }
+    }
+    reversed.close();
+  }
+
+  {
+    text_buffer_type reversed(temp_name);
+    this->backward.insert(reversed, batch_size);
+    reversed.close();
+  }
+  TempFile::remove(temp_name);
+}
+
+//------------------------------------------------------------------------------
+
+BidirectionalState
+BidirectionalGBWT::find(node_type node) const
+{
+  BidirectionalState state;
+  if(node == ENDMARKER) { return state; }
+
+  size_type count = this->forward.count(node);
+  if(count == 0) { return state; }
+
+  state.from = state.to = node;
+  state.forward = state.backward = range_type(0, count - 1);
+  return state;
+}
+
+/*
+  The occurrences of P in the backward index are sorted by the suffixes starting with P.
+  The occurrences of P + to form a subrange, which starts after the occurrences of P
+  followed by a smaller node. The endmarker counts as the smallest node.
+*/
+
+BidirectionalState
+BidirectionalGBWT::extendForward(const BidirectionalState& state, node_type to) const
+{
+  if(state.empty() || to == ENDMARKER) { return BidirectionalState(); }
+
+  const DynamicRecord& record = this->forward.record(state.to);
+  BidirectionalState result;
+  result.forward = record.LF(state.forward, to);
+  if(Range::empty(result.forward)) { return BidirectionalState(); }
+
+  result.from = state.from; result.to = to;
+  result.backward.first = state.backward.first + record.countSmaller(state.forward, to);
+  result.backward.second = result.backward.first + Range::length(result.forward) - 1;
+  return result;
+}
+
+BidirectionalState
+BidirectionalGBWT::extendBackward(const BidirectionalState& state, node_type from) const
+{
+  if(state.empty() || from == ENDMARKER) { return BidirectionalState(); }
+
+  const DynamicRecord& record = this->backward.record(state.from);
+  BidirectionalState result;
+  result.backward = record.LF(state.backward, from);
+  if(Range::empty(result.backward)) { return BidirectionalState(); }
+
+  result.from = from; result.to = state.to;
+  result.forward.first = state.forward.first + record.countSmaller(state.backward, from);
+  result.forward.second = result.forward.first + Range::length(result.backward) - 1;
+  return result;
+}
+
+//------------------------------------------------------------------------------
+
+void
+printStatistics(const BidirectionalGBWT& gbwt, const std::string& name)
+{
+  printStatistics(gbwt.forward, name + " (forward)");
+  printStatistics(gbwt.backward, name + " (backward)");
+}
+
+//------------------------------------------------------------------------------
+
+} // namespace gbwt
@@ -0,0 +1,160 @@
+/*
+  Copyright (c) 2017 Genome Research Ltd.
+
+  Author: Jouni Siren <jouni.siren@iki.fi>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+
+#ifndef GBWT_BIDIRECTIONAL_H
+#define GBWT_BIDIRECTIONAL_H
+
+#include "dynamic_gbwt.h"
+
+namespace gbwt
+{
+
+/*
+  bidirectional.h: Bidirectional GBWT for extending matches in both directions.
+*/
+
+//------------------------------------------------------------------------------
+
+/*
+  The state of a bidirectional search for pattern P = from ... to.
+
+  - 'forward' is the range of the occurrences of P in record 'to' of the forward index.
+  - 'backward' is the range of the occurrences of reverse(P) in record 'from' of the
+    backward index.
+
+  Both ranges always have the same length.
+*/
+
+struct BidirectionalState
+{
+  node_type  from, to;
+  range_type forward, backward;
+
+  BidirectionalState() :
+    from(ENDMARKER), to(ENDMARKER),
+    forward(Range::empty_range()), backward(Range::empty_range())
+  {
+  }
+
+  inline size_type size() const { return Range::length(this->forward); }
+  inline bool empty() const { return Range::empty(this->forward); }
+};
+
+std::ostream& operator<<(std::ostream& out, const BidirectionalState& state);
+
+//------------------------------------------------------------------------------
+
+/*
+  A pair of dynamic GBWTs: the forward index contains the sequences and the backward
+  index contains the reverse sequences. Sequence i in the forward index corresponds to
+  sequence i in the backward index.
+
+  The forward index supports extending the pattern to the right, while the backward
+  index supports extending it to the left. Each extension also updates the range in
+  the other index by counting the occurrences with a smaller successor node.
+*/
+
+class BidirectionalGBWT
+{
+public:
+  typedef DynamicGBWT::size_type size_type;
+
+//------------------------------------------------------------------------------
+
+  BidirectionalGBWT();
+  BidirectionalGBWT(const BidirectionalGBWT& source);
+  BidirectionalGBWT(BidirectionalGBWT&& source);
+  ~BidirectionalGBWT();
+
+  void swap(BidirectionalGBWT& another);
+  BidirectionalGBWT& operator=(const BidirectionalGBWT& source);
+  BidirectionalGBWT& operator=(BidirectionalGBWT&& source);
+
+  size_type serialize(std::ostream& out, sdsl::structure_tree_node* v = nullptr, std::string name = "") const;
+  void load(std::istream& in);
+
+  const static std::string EXTENSION; // .bgbwt
+
+//------------------------------------------------------------------------------
+
+  /*
+    Insert the sequences into the forward index and the reverse sequences into the
+    backward index. The input format is the same as in DynamicGBWT::insert().
+  */
+  void insert(const text_type& text);
+  void insert(text_buffer_type& text, size_type batch_size = DynamicGBWT::INSERT_BATCH_SIZE);
+
+//------------------------------------------------------------------------------
+
+  inline size_type size() const { return this->forward.size(); }
+  inline bool empty() const { return this->forward.empty(); }
+  inline size_type sequences() const { return this->forward.sequences(); }
+  inline size_type sigma() const { return this->forward.sigma(); }
+
+  inline bool contains(node_type node) const { return this->forward.contains(node); }
+
+//------------------------------------------------------------------------------
+
+  /*
+    The interface assumes that the node identifiers are valid. They can be checked with
+    contains(). The endmarker cannot be used in the patterns.
+  */
+
+  // Returns the state for the pattern consisting of the given node.
+  BidirectionalState find(node_type node) const;
+
+  // Returns the state for pattern P + to or an empty state if there are no occurrences.
+  BidirectionalState extendForward(const BidirectionalState& state, node_type to) const;
+
+  // Returns the state for pattern from + P or an empty state if there are no occurrences.
+  BidirectionalState extendBackward(const BidirectionalState& state, node_type from) const;
+
+//------------------------------------------------------------------------------
+
+  DynamicGBWT forward, backward;
+
+//------------------------------------------------------------------------------
+
+private:
+  void copy(const BidirectionalGBWT& source);
+
+//------------------------------------------------------------------------------
+
+}; // class BidirectionalGBWT
+
+void printStatistics(const BidirectionalGBWT& gbwt, const std::string& name);
+
+//------------------------------------------------------------------------------
+
+/*
+  Reverse each sequence in the text. The endmarkers stay at the ends of the sequences.
+*/
+void reverseSequences(const text_type& text, text_type& result);
+
+//------------------------------------------------------------------------------
+
+} // namespace gbwt
+
+#endif // GBWT_BIDIRECTIONAL_H
@@ -30,10 +30,14 @@ using namespace gbwt;
 
 //------------------------------------------------------------------------------
 
+const std::string ORDER_EXTENSION = ".order";
+
 void printUsage(int exit_code = EXIT_SUCCESS);
 
+sdsl::int_vector<0> reorderSequences(const std::string& base_name, const std::string& output_name);
+
 template<class GBWTType>
-void verify(const std::string& base_name);
+void verify(const std::string& base_name, const sdsl::int_vector<0>& order);
 
 //------------------------------------------------------------------------------
 
@@ -43,14 +47,22 @@ main(int argc, char** argv)
   if(argc < 2) { printUsage(); }
 
   size_type batch_size = DynamicGBWT::INSERT_BATCH_SIZE / MILLION;
-  bool verify_index = false;
+  bool verify_index = false, store_incoming = false, reorder = false, compare_runs = false, lockstep = false;
   int c = 0;
-  while((c = getopt(argc, argv, "b:v")) != -1)
+  while((c = getopt(argc, argv, "b:cilrv")) != -1)
   {
     switch(c)
     {
     case 'b':
       batch_size = std::stoul(optarg); break;
+    case 'c':
+      compare_runs = true; break;
+    case 'i':
+      store_incoming = true; break;
+    case 'l':
+      lockstep = true; break;
+    case 'r':
+      reorder = true; break;
     case 'v':
       verify_index = true; break;
     case '?':
@@ -67,13 +79,40 @@ main(int argc, char** argv)
 
   printHeader("Base name"); std::cout << base_name << std::endl;
   if(batch_size != 0) { printHeader("Batch size"); std::cout << batch_size << " million" << std::endl; }
+  if(store_incoming) { printHeader("Incoming edges"); std::cout << "stored" << std::endl; }
+  if(lockstep) { printHeader("Construction"); std::cout << "lockstep" << std::endl; }
+  if(reorder) { printHeader("Sequence order"); std::cout << "lexicographic" << std::endl; }
   std::cout << std::endl;
 
   double start = readTimer();
 
+  // Insert the sequences in lexicographic order and store the original identifiers.
+  sdsl::int_vector<0> order;
+  std::string input_name = base_name;
+  if(reorder)
+  {
+    input_name = TempFile::getName("build_gbwt");
+    order = reorderSequences(base_name, input_name);
+    sdsl::store_to_file(order, base_name + ORDER_EXTENSION);
+  }
+
   DynamicGBWT gbwt;
-  text_buffer_type input(base_name);
-  gbwt.insert(input, batch_size * MILLION);
+  {
+    text_buffer_type input(input_name);
+    if(lockstep)
+    {
+      text_type text(input.size(), 0, input.width());
+      for(size_type i = 0; i < input.size(); i++) { text[i] = input[i]; }
+      if(!(gbwt.insertLockstep(text)))
+      {
+        std::cerr << "build_gbwt: The sequences are not increasing; using normal construction" << std::endl;
+        lockstep = false;
+      }
+    }
+    if(!lockstep) { gbwt.insert(input, batch_size * MILLION); }
+  }
+  if(reorder) { TempFile::remove(input_name); }
+  if(store_incoming) { gbwt.header.flags |= GBWTHeader::FLAG_INCOMING; }
 
   std::string gbwt_name = base_name + DynamicGBWT::EXTENSION;
   sdsl::store_to_file(gbwt, gbwt_name);
@@ -86,14 +125,25 @@ main(int argc, char** argv)
   std::cout << "Memory usage " << inGigabytes(memoryUsage()) << " GB" << std::endl;
   std::cout << std::endl;
 
+  if(reorder && compare_runs)
+  {
+    DynamicGBWT original;
+    text_buffer_type input(base_name);
+    original.insert(input, batch_size * MILLION);
+    size_type before = original.runs(), after = gbwt.runs();
+    printHeader("Runs (input)"); std::cout << before << std::endl;
+    printHeader("Runs (reordered)"); std::cout << after << " (" << (100.0 * after) / std::max(before, (size_type)1) << "%)" << std::endl;
+    std::cout << std::endl;
+  }
+
   sdsl::util::clear(gbwt);
   if(verify_index)
   {
     std::cout << "Verifying compressed GBWT..." << std::endl;
-    verify<GBWT>(base_name);
+    verify<GBWT>(base_name, order);
 
     std::cout << "Verifying dynamic GBWT..." << std::endl;
-    verify<DynamicGBWT>(base_name);
+    verify<DynamicGBWT>(base_name, order);
   }
 
   return 0;
@@ -107,17 +157,78 @@ printUsage(int exit_code)
   std::cerr << "Usage: build_gbwt [options] base_name" << std::endl;
   std::cerr << "  -b N  Insert in batches of N million nodes (default "
             << (DynamicGBWT::INSERT_BATCH_SIZE / MILLION) << ")" << std::endl;
+  std::cerr << "  -c    Compare the number of runs to the input order (with -r)" << std::endl;
+  std::cerr << "  -i    Store the incoming edges in the compressed GBWT" << std::endl;
+  std::cerr << "  -l    Lockstep construction for sequences with increasing node ids" << std::endl;
+  std::cerr << "  -r    Reorder the sequences to reduce the number of runs" << std::endl;
   std::cerr << "  -v    Verify the index after construction" << std::endl;
   std::cerr << std::endl;
+  std::cerr << "With -r, the original identifiers of the sequences are stored in base_name" << ORDER_EXTENSION << "." << std::endl;
+  std::cerr << std::endl;
 
   std::exit(exit_code);
 }
 
 //------------------------------------------------------------------------------
 
+/*
+  The order of the sequences in the endmarker determines how ties are broken between
+  sequences with the same prefix in every record. When similar sequences have adjacent
+  identifiers, they tend to be in the same runs in the following records. We sort the
+  sequences lexicographically, which clusters sequences sharing long prefixes together.
+
+  Writes the reordered text to the output file and returns the original identifier of
+  each sequence in the new order.
+*/
+
+sdsl::int_vector<0>
+reorderSequences(const std::string& base_name, const std::string& output_name)
+{
+  text_type text;
+  std::vector<size_type> starts;
+  {
+    text_buffer_type input(base_name);
+    text = text_type(input.size(), 0, input.width());
+    bool seq_start = true;
+    for(size_type i = 0; i < input.size(); i++)
+    {
+      text[i] = input[i];
+      if(seq_start) { starts.push_back(i); seq_start = false; }
+      if(text[i] == ENDMARKER) { seq_start = true; }
+    }
+  }
+
+  std::vector<size_type> order(starts.size());
+  for(size_type i = 0; i < order.size(); i++) { order[i] = i; }
+  auto less = [&](size_type a, size_type b) -> bool
+  {
+    size_type i = starts[a], j = starts[b];
+    while(text[i] == text[j] && text[i] != ENDMARKER) { i++; j++; }
+    return (text[i] < text[j]);
+  };
+  std::stable_sort(order.begin(), order.end(), less);
+
+  sdsl::int_vector<0> result(order.size(), 0, bit_length(std::max(order.size(), (size_type)1)));
+  text_buffer_type output(output_name, std::ios::out, MEGABYTE, text.width());
+  for(size_type i = 0; i < order.size(); i++)
+  {
+    result[i] = order[i];
+    for(size_type j = starts[order[i]]; ; j++)
+    {
+      output.push_back(text[j]);
+      if(text[j] == ENDMARKER) { break; }
+    }
+  }
+  output.close();
+
+  return result;
+}
+
+//------------------------------------------------------------------------------
+
 template<class GBWTType>
 void
-verify(const std::string& base_name)
+verify(const std::string& base_name, const sdsl::int_vector<0>& order)
 {
   double start = readTimer();
 
@@ -138,7 +249,7 @@ verify(const std::string& base_name)
   if(offsets.empty()) { return; }
   std::vector<range_type> blocks = Range::partition(range_type(0, offsets.size() - 1), 4 * omp_get_max_threads());
 
-  bool failed = false;
+  bool failed = false, check_incoming = (gbwt.header.flags & GBWTHeader::FLAG_INCOMING);
   std::atomic<size_type> samples_found(0);
   #pragma omp parallel for schedule(dynamic, 1)
   for(size_type block = 0; block < blocks.size(); block++)
@@ -147,7 +258,8 @@ verify(const std::string& base_name)
     for(size_type sequence = blocks[block].first; sequence <= blocks[block].second; sequence++)
     {
       edge_type current(ENDMARKER, sequence);
-      size_type offset = offsets[sequence];
+      size_type original = (order.empty() ? sequence : order[sequence]);
+      size_type offset = offsets[original];
       while(true)
       {
         // Check for a sample.
@@ -160,7 +272,7 @@ verify(const std::string& base_name)
             #pragma omp critical
             {
               std::cerr << "build_gbwt: Index verification failed with sequence " << sequence << ", offset "
-                        << (offset - offsets[sequence]) << std::endl;
+                        << (offset - offsets[original]) << std::endl;
               std::cerr << "build_gbwt: Sample had sequence id " << sample << std::endl;
               failed = true;
             }
@@ -176,13 +288,26 @@ verify(const std::string& base_name)
           #pragma omp critical
           {
             std::cerr << "build_gbwt: Index verification failed with sequence " << sequence << ", offset "
-                      << (offset - offsets[sequence]) << std::endl;
+                      << (offset - offsets[original]) << std::endl;
             std::cerr << "build_gbwt: Expected an edge from " << current.first << " to " << text[offset]
                       << ", ended up in " << next.first << std::endl;
             failed = true;
           }
           break;
         }
+
+        // Verify inverse LF().
+        if(check_incoming && gbwt.inverseLF(next) != current)
+        {
+          #pragma omp critical
+          {
+            std::cerr << "build_gbwt: Index verification failed with sequence " << sequence << ", offset "
+                      << (offset - offsets[original]) << std::endl;
+            std::cerr << "build_gbwt: Inverse LF from " << next << " did not return " << current << std::endl;
+            failed = true;
+          }
+          break;
+        }
         current = next; offset++;
       }
     }
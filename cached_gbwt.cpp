@@ -0,0 +1,135 @@
+/*
+  Copyright (c) 2017 Genome Research Ltd.
+
+  Author: Jouni Siren <jouni.siren@iki.fi>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+
+#include "cached_gbwt.h"
+
+namespace gbwt
+{
+
+//------------------------------------------------------------------------------
+
+CachedGBWT::CachedGBWT(const GBWT& gbwt, size_type budget, size_type access_threshold) :
+  index(gbwt), budget_bytes(budget), threshold(std::max(access_threshold, (size_type)1)),
+  counters(new std::atomic<std::uint32_t>[gbwt.effective()]),
+  records(new std::atomic<const DecodedRecord*>[gbwt.effective()]),
+  used_bytes(0)
+{
+  for(comp_type comp = 0; comp < this->effective(); comp++)
+  {
+    this->counters[comp] = 0;
+    this->records[comp] = nullptr;
+  }
+}
+
+CachedGBWT::~CachedGBWT()
+{
+  for(comp_type comp = 0; comp < this->effective(); comp++)
+  {
+    delete this->records[comp].load();
+  }
+}
+
+size_type
+CachedGBWT::cachedRecords() const
+{
+  size_type result = 0;
+  for(comp_type comp = 0; comp < this->effective(); comp++)
+  {
+    if(this->records[comp].load(std::memory_order_relaxed) != nullptr) { result++; }
+  }
+  return result;
+}
+
+//------------------------------------------------------------------------------
+
+size_type
+CachedGBWT::locate(node_type node, size_type i) const
+{
+  if(!(this->contains(node))) { return invalid_sequence(); }
+
+  while(true)
+  {
+    size_type result = this->tryLocate(node, i);
+    if(result != invalid_sequence()) { return result; }
+    std::tie(node, i) = this->LF(node, i);
+  }
+}
+
+//------------------------------------------------------------------------------
+
+const DecodedRecord*
+CachedGBWT::find(comp_type comp) const
+{
+  const DecodedRecord* result = this->records[comp].load(std::memory_order_acquire);
+  if(result != nullptr) { return result; }
+
+  /*
+    Increment the counter unless the record has been rejected or another thread has
+    already reached the threshold. Only the thread that reaches the threshold decodes
+    the record.
+  */
+  std::atomic<std::uint32_t>& counter = this->counters[comp];
+  std::uint32_t count = counter.load(std::memory_order_relaxed);
+  while(count != REJECTED && count < this->threshold)
+  {
+    if(counter.compare_exchange_weak(count, count + 1, std::memory_order_relaxed))
+    {
+      return (count + 1 == this->threshold ? this->decode(comp) : nullptr);
+    }
+  }
+  return nullptr;
+}
+
+const DecodedRecord*
+CachedGBWT::decode(comp_type comp) const
+{
+  CompressedRecord record = this->index.record(this->toNode(comp));
+  size_type runs = record.runs();
+  size_type bytes = DecodedRecord::bytes(record.outdegree(), runs);
+  if(runs < MIN_RUNS || !(this->reserve(bytes)))
+  {
+    this->counters[comp] = REJECTED;
+    return nullptr;
+  }
+
+  const DecodedRecord* decoded = new DecodedRecord(record);
+  this->records[comp].store(decoded, std::memory_order_release);
+  return decoded;
+}
+
+bool
+CachedGBWT::reserve(size_type bytes) const
+{
+  size_type used = this->used_bytes.load(std::memory_order_relaxed);
+  while(used + bytes <= this->budget_bytes)
+  {
+    if(this->used_bytes.compare_exchange_weak(used, used + bytes, std::memory_order_relaxed)) { return true; }
+  }
+  return false;
+}
+
+//------------------------------------------------------------------------------
+
+} // namespace gbwt
@@ -0,0 +1,158 @@
+/*
+  Copyright (c) 2017 Genome Research Ltd.
+
+  Author: Jouni Siren <jouni.siren@iki.fi>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+
+#ifndef GBWT_CACHED_GBWT_H
+#define GBWT_CACHED_GBWT_H
+
+#include <memory>
+
+#include "gbwt.h"
+
+namespace gbwt
+{
+
+/*
+  cached_gbwt.h: A cache of decoded records for frequently accessed nodes.
+*/
+
+//------------------------------------------------------------------------------
+
+/*
+  A thread-safe view of a compressed GBWT that caches decoded records. Each record
+  has an access counter, which is incremented every time the record is queried
+  while not in the cache. When the counter reaches the threshold, the record is
+  decoded and cached if it has enough runs and the decoded record fits in the
+  remaining budget. Cached records are never evicted, so the cache ends up containing
+  the records that became hot first.
+
+  The GBWT must not be modified or destroyed while the cache exists.
+*/
+
+class CachedGBWT
+{
+public:
+  typedef GBWT::size_type size_type;
+  typedef GBWT::comp_type comp_type;
+
+  const static size_type DEFAULT_BUDGET    = 256 * MEGABYTE; // Bytes.
+  const static size_type DEFAULT_THRESHOLD = 64;             // Accesses.
+  const static size_type MIN_RUNS          = 16;             // Smaller records are not cached.
+
+//------------------------------------------------------------------------------
+
+  explicit CachedGBWT(const GBWT& gbwt, size_type budget = DEFAULT_BUDGET, size_type threshold = DEFAULT_THRESHOLD);
+  ~CachedGBWT();
+
+  inline size_type size() const { return this->index.size(); }
+  inline bool empty() const { return this->index.empty(); }
+  inline size_type sequences() const { return this->index.sequences(); }
+  inline size_type sigma() const { return this->index.sigma(); }
+  inline size_type effective() const { return this->index.effective(); }
+  inline bool contains(node_type node) const { return this->index.contains(node); }
+  inline comp_type toComp(node_type node) const { return this->index.toComp(node); }
+  inline node_type toNode(comp_type comp) const { return this->index.toNode(comp); }
+
+  // Cache statistics.
+  size_type cachedRecords() const;
+  inline size_type cachedBytes() const { return this->used_bytes; }
+  inline size_type budget() const { return this->budget_bytes; }
+
+  // Number of uncached accesses to the record or REJECTED if the record will not be cached.
+  inline size_type accesses(node_type node) const
+  {
+    return this->counters[this->toComp(node)].load(std::memory_order_relaxed);
+  }
+
+  const static std::uint32_t REJECTED = ~(std::uint32_t)0;
+
+//------------------------------------------------------------------------------
+
+  /*
+    The interface assumes that the node identifiers are valid. They can be checked with
+    contains().
+  */
+
+  // On error: invalid_edge().
+  inline edge_type LF(node_type from, size_type i) const
+  {
+    const DecodedRecord* decoded = this->find(this->toComp(from));
+    return (decoded != nullptr ? decoded->LF(i) : this->index.LF(from, i));
+  }
+
+  // On error: invalid_edge().
+  inline edge_type LF(edge_type position) const { return this->LF(position.first, position.second); }
+
+  // On error: invalid_offset().
+  inline size_type LF(node_type from, size_type i, node_type to) const
+  {
+    const DecodedRecord* decoded = this->find(this->toComp(from));
+    return (decoded != nullptr ? decoded->LF(i, to) : this->index.LF(from, i, to));
+  }
+
+  // On error: invalid_offset().
+  inline size_type LF(edge_type position, node_type to) const { return this->LF(position.first, position.second, to); }
+
+  // On error: Range::empty_range().
+  inline range_type LF(node_type from, range_type range, node_type to) const
+  {
+    const DecodedRecord* decoded = this->find(this->toComp(from));
+    return (decoded != nullptr ? decoded->LF(range, to) : this->index.LF(from, range, to));
+  }
+
+  // Returns the sampled document identifier or invalid_sequence() if there is no sample.
+  inline size_type tryLocate(node_type node, size_type i) const { return this->index.tryLocate(node, i); }
+  inline size_type tryLocate(edge_type position) const { return this->index.tryLocate(position); }
+
+  // On error: invalid_sequence().
+  size_type locate(node_type node, size_type i) const;
+  inline size_type locate(edge_type position) const { return this->locate(position.first, position.second); }
+
+//------------------------------------------------------------------------------
+
+  const GBWT& index;
+
+private:
+  size_type budget_bytes, threshold;
+
+  std::unique_ptr<std::atomic<std::uint32_t>[]>        counters;
+  std::unique_ptr<std::atomic<const DecodedRecord*>[]> records;
+  mutable std::atomic<size_type>                       used_bytes;
+
+  CachedGBWT(const CachedGBWT&) = delete;
+  CachedGBWT& operator=(const CachedGBWT&) = delete;
+
+  // Returns the cached record or nullptr. May decode the record.
+  const DecodedRecord* find(comp_type comp) const;
+  const DecodedRecord* decode(comp_type comp) const;
+
+  // Reserves the bytes from the budget. Returns false if they do not fit.
+  bool reserve(size_type bytes) const;
+};
+
+//------------------------------------------------------------------------------
+
+} // namespace gbwt
+
+#endif // GBWT_CACHED_GBWT_H
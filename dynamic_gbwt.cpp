@@ -25,6 +25,8 @@
 #include "dynamic_gbwt.h"
 #include "internal.h"
 
+#include <unordered_map>
+
 namespace gbwt
 {
 
@@ -32,16 +34,19 @@ namespace gbwt
 
 const std::string DynamicGBWT::EXTENSION = ".gbwt";
 
-DynamicGBWT::DynamicGBWT()
+DynamicGBWT::DynamicGBWT() :
+  thread_budget(omp_get_max_threads())
 {
 }
 
-DynamicGBWT::DynamicGBWT(const DynamicGBWT& source)
+DynamicGBWT::DynamicGBWT(const DynamicGBWT& source) :
+  thread_budget(omp_get_max_threads())
 {
   this->copy(source);
 }
 
-DynamicGBWT::DynamicGBWT(DynamicGBWT&& source)
+DynamicGBWT::DynamicGBWT(DynamicGBWT&& source) :
+  thread_budget(omp_get_max_threads())
 {
   *this = std::move(source);
 }
@@ -57,6 +62,9 @@ DynamicGBWT::swap(DynamicGBWT& another)
   {
     this->header.swap(another.header);
     this->bwt.swap(another.bwt);
+    this->endmarker.swap(another.endmarker);
+    this->current_snapshot.swap(another.current_snapshot);
+    std::swap(this->thread_budget, another.thread_budget);
   }
 }
 
@@ -74,6 +82,9 @@ DynamicGBWT::operator=(DynamicGBWT&& source)
   {
     this->header = std::move(source.header);
     this->bwt = std::move(source.bwt);
+    this->endmarker = std::move(source.endmarker);
+    this->current_snapshot = std::move(source.current_snapshot);
+    this->thread_budget = source.thread_budget;
   }
   return *this;
 }
@@ -96,6 +107,12 @@ DynamicGBWT::serialize(std::ostream& out, sdsl::structure_tree_node* v, std::str
     written_bytes += compressed_samples.serialize(out, child, "da_samples");
   }
 
+  if(this->header.flags & GBWTHeader::FLAG_INCOMING)
+  {
+    IncomingEdges incoming(this->bwt);
+    written_bytes += incoming.serialize(out, child, "incoming");
+  }
+
   sdsl::structure_tree::add_size(child, written_bytes);
   return written_bytes;
 }
@@ -123,13 +140,17 @@ DynamicGBWT::load(std::istream& in)
       current.clear();
 
       // Decompress the outgoing edges.
-      current.outgoing.resize(ByteCode::read(array.data, offset));
+      size_type outdegree = ByteCode::read(array.data, offset);
+      current.outgoing.reserve(outdegree);
+      current.sorted_outgoing = true; // Serialized edges are sorted.
       node_type prev = 0;
-      for(edge_type& outedge : current.outgoing)
+      for(rank_type outrank = 0; outrank < outdegree; outrank++)
       {
+        edge_type outedge;
         outedge.first = ByteCode::read(array.data, offset) + prev;
         prev = outedge.first;
         outedge.second = ByteCode::read(array.data, offset);
+        current.outgoing.push_back(outedge);
       }
 
       // Decompress the body.
@@ -150,41 +171,58 @@ DynamicGBWT::load(std::istream& in)
   {
     DASamples samples;
     samples.load(in);
-    sdsl::sd_vector<>::select_1_type offset_select(&(samples.sampled_offsets));
-    size_type record_rank = 0, max_rank = samples.record_rank(samples.sampled_records.size());
-    size_type record_start = 0;
-    size_type sample_rank = 0;
+    std::vector<std::vector<sample_type>> decompressed = samples.decompress();
+    for(comp_type comp = 0; comp < this->effective() && comp < decompressed.size(); comp++)
+    {
+      this->bwt[comp].ids.assign(decompressed[comp]);
+      std::vector<sample_type>().swap(decompressed[comp]);
+    }
+  }
+
+  // Read and decompress the incoming edges if they are present. Otherwise rebuild them.
+  if(this->header.flags & GBWTHeader::FLAG_INCOMING)
+  {
+    IncomingEdges incoming;
+    incoming.load(in);
+    size_type offset = 0;
     for(comp_type comp = 0; comp < this->effective(); comp++)
     {
-      if(samples.sampled_records[comp] == 0) { continue; }
       DynamicRecord& current = this->bwt[comp];
-      size_type limit = (record_rank + 1 < max_rank ? samples.bwt_select(record_rank + 2) : samples.bwt_ranges.size());
-      while(sample_rank < samples.size())
+      size_type indegree = ByteCode::read(incoming.data, offset);
+      current.incoming.reserve(indegree);
+      node_type prev = 0;
+      for(rank_type inrank = 0; inrank < indegree; inrank++)
       {
-        size_type sample_offset = offset_select(sample_rank + 1);
-        if(sample_offset >= limit) { break; }
-        current.ids.push_back(sample_type(sample_offset - record_start, samples.array[sample_rank]));
-        sample_rank++;
+        edge_type inedge;
+        inedge.first = ByteCode::read(incoming.data, offset) + prev;
+        prev = inedge.first;
+        inedge.second = ByteCode::read(incoming.data, offset);
+        current.incoming.push_back(inedge);
       }
-      record_rank++; record_start = limit;
     }
   }
-
-  // Rebuild the incoming edges.
-  for(comp_type comp = 0; comp < this->effective(); comp++)
+  else
   {
-    DynamicRecord& current = this->bwt[comp];
-    std::vector<size_type> counts(current.outdegree());
-    for(run_type run : current.body) { counts[run.first] += run.second; }
-    for(rank_type outrank = 0; outrank < current.outdegree(); outrank++)
+    for(comp_type comp = 0; comp < this->effective(); comp++)
     {
-      if(current.successor(outrank) != ENDMARKER)
+      DynamicRecord& current = this->bwt[comp];
+      std::vector<size_type> counts(current.outdegree());
+      for(run_type run : current.body) { counts[run.first] += run.second; }
+      for(rank_type outrank = 0; outrank < current.outdegree(); outrank++)
       {
-        DynamicRecord& successor = this->record(current.successor(outrank));
-        successor.addIncoming(edge_type(comp, counts[outrank]));
+        if(current.successor(outrank) != ENDMARKER)
+        {
+          DynamicRecord& successor = this->record(current.successor(outrank));
+          successor.addIncoming(edge_type(this->toNode(comp), counts[outrank]));
+        }
       }
     }
   }
+
+  this->rebuildEndmarker();
+
+  // The old snapshot does not correspond to the new contents.
+  if(this->snapshotsEnabled()) { this->enableSnapshots(); }
 }
 
 void
@@ -192,6 +230,9 @@ DynamicGBWT::copy(const DynamicGBWT& source)
 {
   this->header = source.header;
   this->bwt = source.bwt;
+  this->endmarker = source.endmarker;
+  this->current_snapshot = source.snapshot();
+  this->thread_budget = source.thread_budget;
 }
 
 //------------------------------------------------------------------------------
@@ -265,10 +306,24 @@ DynamicGBWT::recode()
     std::cerr << "DynamicGBWT::recode(): Sorting the outgoing edges" << std::endl;
   }
 
-  #pragma omp parallel for schedule(static)
+  #pragma omp parallel for num_threads(this->threads()) schedule(static)
   for(comp_type comp = 0; comp < this->effective(); comp++) { this->bwt[comp].recode(); }
 }
 
+void
+DynamicGBWT::rebuildEndmarker()
+{
+  this->endmarker = (this->effective() > 0 ? EndmarkerIndex(this->record(ENDMARKER)) : EndmarkerIndex());
+}
+
+void
+DynamicGBWT::extendEndmarker()
+{
+  if(this->effective() == 0) { return; }
+  const DynamicRecord& record = this->record(ENDMARKER);
+  this->endmarker.extend(record, record.size() - this->endmarker.size());
+}
+
 //------------------------------------------------------------------------------
 
 /*
@@ -283,6 +338,38 @@ swapBody(DynamicRecord& record, RunMerger& merger)
   std::swap(merger.total_size, record.body_size);
 }
 
+/*
+  Maps successor nodes to outranks in a record during construction, when the outgoing
+  edges are not sorted. Records with many outgoing edges use a hash index, which is
+  built on first use and kept up to date when edges are added through it.
+*/
+
+struct OutrankIndex
+{
+  std::unordered_map<node_type, rank_type> outranks;
+
+  // Returns record.outdegree() if there is no edge to the destination.
+  rank_type edgeTo(const DynamicRecord& record, node_type to)
+  {
+    if(this->outranks.empty())
+    {
+      if(record.outdegree() <= SMALL_OUTDEGREE) { return record.edgeTo(to); }
+      for(rank_type outrank = 0; outrank < record.outdegree(); outrank++)
+      {
+        this->outranks[record.successor(outrank)] = outrank;
+      }
+    }
+    auto iter = this->outranks.find(to);
+    return (iter == this->outranks.end() ? record.outdegree() : iter->second);
+  }
+
+  void addEdge(DynamicRecord& record, node_type to)
+  {
+    record.addOutgoing(to);
+    if(!(this->outranks.empty())) { this->outranks[to] = record.outdegree() - 1; }
+  }
+};
+
 /*
   Process ranges of sequences sharing the same 'curr' node.
   - Add the outgoing edge (curr, next) if necessary.
@@ -295,34 +382,37 @@ swapBody(DynamicRecord& record, RunMerger& merger)
   and because searching with the endmarker does not work in a multi-string BWT.
 */
 
+template<class SequenceType>
 void
-updateRecords(DynamicGBWT& gbwt, std::vector<Sequence>& seqs, size_type iteration)
+updateRecords(DynamicGBWT& gbwt, std::vector<SequenceType>& seqs, size_type iteration)
 {
   for(size_type i = 0; i < seqs.size(); )
   {
     node_type curr = seqs[i].curr;
     DynamicRecord& current = gbwt.record(curr);
     RunMerger new_body(current.outdegree());
-    std::vector<sample_type> new_samples;
-    std::vector<run_type>::iterator iter = current.body.begin();
-    std::vector<sample_type>::iterator sample_iter = current.ids.begin();
-    size_type insert_count = 0;
+    PairVector new_samples;
+    PairVector::const_iterator iter = current.body.begin();
+    PairVector::const_iterator sample_iter = current.ids.begin();
+    size_type insert_count = 0, consumed = 0; // 'consumed' is the used part of the run at 'iter'.
+    OutrankIndex index;
     while(i < seqs.size() && seqs[i].curr == curr)
     {
-      rank_type outrank = current.edgeTo(seqs[i].next);
+      rank_type outrank = index.edgeTo(current, seqs[i].next);
       if(outrank >= current.outdegree())  // Add edge (curr, next) if it does not exist.
       {
-        current.outgoing.push_back(edge_type(seqs[i].next, 0));
+        index.addEdge(current, seqs[i].next);
         new_body.addEdge();
       }
       while(new_body.size() < seqs[i].offset)  // Add old runs until 'offset'.
       {
-        if(iter->second <= seqs[i].offset - new_body.size()) { new_body.insert(*iter); ++iter; }
+        run_type run = *iter; run.second -= consumed;
+        if(run.second <= seqs[i].offset - new_body.size()) { new_body.insert(run); ++iter; consumed = 0; }
         else
         {
-          run_type temp(iter->first, seqs[i].offset - new_body.size());
-          new_body.insert(temp);
-          iter->second -= temp.second;
+          run.second = seqs[i].offset - new_body.size();
+          new_body.insert(run);
+          consumed += run.second;
         }
       }
       // Add old samples until 'offset'.
@@ -345,7 +435,8 @@ updateRecords(DynamicGBWT& gbwt, std::vector<Sequence>& seqs, size_type iteratio
     }
     while(iter != current.body.end()) // Add the rest of the old body.
     {
-      new_body.insert(*iter); ++iter;
+      run_type run = *iter; run.second -= consumed;
+      new_body.insert(run); ++iter; consumed = 0;
     }
     while(sample_iter != current.ids.end()) // Add the rest of the old samples.
     {
@@ -353,7 +444,7 @@ updateRecords(DynamicGBWT& gbwt, std::vector<Sequence>& seqs, size_type iteratio
       ++sample_iter;
     }
     swapBody(current, new_body);
-    current.ids = new_samples;
+    current.ids.swap(new_samples);
   }
   gbwt.header.size += seqs.size();
 }
@@ -363,47 +454,68 @@ updateRecords(DynamicGBWT& gbwt, std::vector<Sequence>& seqs, size_type iteratio
   records have been sorted by the node at the current position.
 */
 
+template<class SequenceType>
 void
-nextPosition(std::vector<Sequence>& seqs, const text_type&)
+nextPosition(std::vector<SequenceType>& seqs, const text_type&)
 {
-  for(Sequence& seq : seqs) { seq.pos++; }
+  for(SequenceType& seq : seqs) { seq.pos++; }
 }
 
-void
-nextPosition(std::vector<Sequence>& seqs, const GBWT& source)
+/*
+  A compressed source GBWT. Seeking from the beginning of a record with a long body is
+  expensive, so the decoding cursors for up to MAX_CURSORS records with bodies of at
+  least LONG_BODY bytes persist across iterations and batches. Such a record is not
+  decoded again from the beginning as long as the sequences reach it in increasing
+  offset order. Other records get a temporary cursor in each iteration.
+*/
+
+struct CompressedSource
 {
-  for(size_type i = 0; i < seqs.size(); )
+  const GBWT& gbwt;
+  std::unordered_map<node_type, std::unique_ptr<CompressedRecordCursor>> cursors;
+
+  const static size_type LONG_BODY   = 256;
+  const static size_type MAX_CURSORS = 65536;
+
+  explicit CompressedSource(const GBWT& source) : gbwt(source) {}
+
+  // Returns a persistent cursor or a cursor owned by 'temporary'.
+  CompressedRecordCursor& cursor(node_type node, std::unique_ptr<CompressedRecordCursor>& temporary)
   {
-    node_type curr = seqs[i].curr;
-    const CompressedRecord current = source.record(curr);
-    CompressedRecordFullIterator iter(current);
-    while(i < seqs.size() && seqs[i].curr == curr)
+    auto iter = this->cursors.find(node);
+    if(iter != this->cursors.end()) { return *(iter->second); }
+    temporary.reset(new CompressedRecordCursor(this->gbwt.record(node)));
+    if(temporary->record.data_size >= LONG_BODY && this->cursors.size() < MAX_CURSORS)
     {
-      while(iter.offset() <= seqs[i].pos) { ++iter; }
-      seqs[i].pos = iter.rank() - (iter.offset() - seqs[i].pos);
-      i++;
+      std::unique_ptr<CompressedRecordCursor>& result = this->cursors[node];
+      result.swap(temporary);
+      return *result;
     }
+    return *temporary;
   }
-}
+};
 
+template<class SequenceType>
 void
-nextPosition(std::vector<Sequence>& seqs, const DynamicGBWT& source)
+nextPosition(std::vector<SequenceType>& seqs, const DynamicGBWT& source)
 {
+  std::vector<size_type> result; // Reused for all records.
   for(size_type i = 0; i < seqs.size(); )
   {
     node_type curr = seqs[i].curr;
     const DynamicRecord& current = source.record(curr);
-    std::vector<run_type>::const_iterator iter = current.body.begin();
-    std::vector<edge_type> result(current.outgoing);
-    size_type record_offset = iter->second; result[iter->first].second += iter->second;
+    PairVector::const_iterator iter = current.body.begin();
+    result.resize(current.outdegree());
+    for(rank_type outrank = 0; outrank < current.outdegree(); outrank++) { result[outrank] = current.offset(outrank); }
+    size_type record_offset = iter->second; result[iter->first] += iter->second;
     while(i < seqs.size() && seqs[i].curr == curr)
     {
       while(record_offset <= seqs[i].pos)
       {
         ++iter; record_offset += iter->second;
-        result[iter->first].second += iter->second;
+        result[iter->first] += iter->second;
       }
-      seqs[i].pos = result[iter->first].second - (record_offset - seqs[i].pos);
+      seqs[i].pos = result[iter->first] - (record_offset - seqs[i].pos);
       i++;
     }
   }
@@ -415,10 +527,11 @@ nextPosition(std::vector<Sequence>& seqs, const DynamicGBWT& source)
   next interation.
 */
 
+template<class SequenceType>
 void
-sortSequences(std::vector<Sequence>& seqs)
+sortSequences(std::vector<SequenceType>& seqs, size_type threads)
 {
-  chooseBestSort(seqs.begin(), seqs.end());
+  chooseBestSortThreads(seqs.begin(), seqs.end(), threads);
   size_type head = 0;
   while(head < seqs.size() && seqs[head].next == ENDMARKER) { head++; }
   if(head > 0)
@@ -433,30 +546,45 @@ sortSequences(std::vector<Sequence>& seqs)
   valid after the insertions in the next iteration.
 
   Then add the rebuilt edge offsets to sequence offsets, which have been rank(next)
-  within the current record until now.
+  within the current record until now. Because the sequences are sorted by (next, curr),
+  the edge offset only has to be found once for each edge.
 */
 
+template<class SequenceType>
 void
-rebuildOffsets(DynamicGBWT& gbwt, std::vector<Sequence>& seqs)
+rebuildOffsets(DynamicGBWT& gbwt, std::vector<SequenceType>& seqs)
 {
+  std::unordered_map<node_type, OutrankIndex> indexes; // For records with many outgoing edges.
+  auto edgeTo = [&](node_type from, node_type to) -> rank_type
+  {
+    const DynamicRecord& record = gbwt.record(from);
+    if(record.outdegree() <= SMALL_OUTDEGREE) { return record.edgeTo(to); }
+    return indexes[from].edgeTo(record, to);
+  };
+
   node_type next = gbwt.sigma();
-  for(const Sequence& seq : seqs)
+  for(const SequenceType& seq : seqs)
   {
     if(seq.next == next) { continue; }
     next = seq.next;
     size_type offset = 0;
     for(edge_type inedge : gbwt.record(next).incoming)
     {
-      DynamicRecord& predecessor = gbwt.record(inedge.first);
-      predecessor.offset(predecessor.edgeTo(next)) = offset;
+      gbwt.record(inedge.first).setOffset(edgeTo(inedge.first, next), offset);
       offset += inedge.second;
     }
   }
 
-  for(Sequence& seq : seqs)
+  node_type curr = gbwt.sigma(); next = gbwt.sigma();
+  size_type edge_offset = 0;
+  for(SequenceType& seq : seqs)
   {
-    const DynamicRecord& current = gbwt.record(seq.curr);
-    seq.offset += current.offset(current.edgeTo(seq.next));
+    if(seq.curr != curr || seq.next != next)
+    {
+      curr = seq.curr; next = seq.next;
+      edge_offset = gbwt.record(curr).offset(edgeTo(curr, next));
+    }
+    seq.offset += edge_offset;
   }
 }
 
@@ -466,40 +594,43 @@ rebuildOffsets(DynamicGBWT& gbwt, std::vector<Sequence>& seqs)
   position.
 */
 
+template<class SequenceType>
 void
-advancePosition(std::vector<Sequence>& seqs, const text_type& text)
+advancePosition(std::vector<SequenceType>& seqs, const text_type& text)
 {
-  for(Sequence& seq : seqs) { seq.curr = seq.next; seq.next = text[seq.pos]; }
+  for(SequenceType& seq : seqs) { seq.curr = seq.next; seq.next = text[seq.pos]; }
 }
 
+template<class SequenceType>
 void
-advancePosition(std::vector<Sequence>& seqs, const GBWT& source)
+advancePosition(std::vector<SequenceType>& seqs, CompressedSource& source)
 {
-  // FIXME We could optimize further by storing the next position.
   for(size_type i = 0; i < seqs.size(); )
   {
     node_type curr = seqs[i].next;
-    const CompressedRecord current = source.record(curr);
-    CompressedRecordIterator iter(current);
+    std::unique_ptr<CompressedRecordCursor> temporary;
+    CompressedRecordCursor& cursor = source.cursor(curr, temporary);
     while(i < seqs.size() && seqs[i].next == curr)
     {
       seqs[i].curr = seqs[i].next;
-      while(iter.offset() <= seqs[i].pos) { ++iter; }
-      seqs[i].next = current.successor(iter->first);
+      cursor.seek(seqs[i].pos);
+      seqs[i].next = cursor.successor();
+      seqs[i].pos = cursor.rankAt(seqs[i].pos);
       i++;
     }
   }
 }
 
+template<class SequenceType>
 void
-advancePosition(std::vector<Sequence>& seqs, const DynamicGBWT& source)
+advancePosition(std::vector<SequenceType>& seqs, const DynamicGBWT& source)
 {
   // FIXME We could optimize further by storing the next position.
   for(size_type i = 0; i < seqs.size(); )
   {
     node_type curr = seqs[i].next;
     const DynamicRecord& current = source.record(curr);
-    std::vector<run_type>::const_iterator iter = current.body.begin();
+    PairVector::const_iterator iter = current.body.begin();
     size_type offset = iter->second;
     while(i < seqs.size() && seqs[i].next == curr)
     {
@@ -511,26 +642,100 @@ advancePosition(std::vector<Sequence>& seqs, const DynamicGBWT& source)
   }
 }
 
+/*
+  List the distinct 'curr' nodes, whose records will be modified in this iteration.
+*/
+
+template<class SequenceType>
+void
+listNodes(const std::vector<SequenceType>& seqs, std::vector<node_type>& touched)
+{
+  for(size_type i = 0; i < seqs.size(); i++)
+  {
+    if(i == 0 || seqs[i].curr != seqs[i - 1].curr) { touched.push_back(seqs[i].curr); }
+  }
+}
+
 /*
   Insert the sequences from the source to the GBWT. Maintains an invariant that
-  the sequences are sorted by (curr, offset).
+  the sequences are sorted by (curr, offset). If 'touched' is not null, the nodes
+  with modified records are appended to it.
 */
 
-template<class Source>
+template<class SequenceType, class Source>
 size_type
-insert(DynamicGBWT& gbwt, std::vector<Sequence>& seqs, const Source& source)
+insert(DynamicGBWT& gbwt, std::vector<SequenceType>& seqs, Source& source, std::vector<node_type>* touched)
 {
   for(size_type iterations = 1; ; iterations++)
   {
+    if(touched != nullptr) { listNodes(seqs, *touched); }
     updateRecords(gbwt, seqs, iterations);  // Insert the next nodes into the GBWT.
     nextPosition(seqs, source); // Determine the next position for each sequence.
-    sortSequences(seqs);  // Sort for the next iteration and remove the ones that have finished.
+    sortSequences(seqs, gbwt.threads());  // Sort for the next iteration and remove the ones that have finished.
     if(seqs.empty()) { return iterations; }
     rebuildOffsets(gbwt, seqs); // Rebuild offsets in outgoing edges and sequences.
     advancePosition(seqs, source);  // Move the sequences to the next position.
   }
 }
 
+/*
+  With a compressed source, advancePosition() maps the source offset to the next record
+  while it finds the next node, so there is no separate nextPosition() step.
+*/
+
+template<class SequenceType>
+size_type
+insert(DynamicGBWT& gbwt, std::vector<SequenceType>& seqs, CompressedSource& source, std::vector<node_type>* touched)
+{
+  for(size_type iterations = 1; ; iterations++)
+  {
+    if(touched != nullptr) { listNodes(seqs, *touched); }
+    updateRecords(gbwt, seqs, iterations);  // Insert the next nodes into the GBWT.
+    sortSequences(seqs, gbwt.threads());  // Sort for the next iteration and remove the ones that have finished.
+    if(seqs.empty()) { return iterations; }
+    rebuildOffsets(gbwt, seqs); // Rebuild offsets in outgoing edges and sequences.
+    advancePosition(seqs, source);  // Move the sequences to the next position and map the offsets.
+  }
+}
+
+/*
+  Create the iterators for the sequences in the text or for source sequences [from, to)
+  using the given sequence type, and insert the sequences. The new sequences get
+  identifiers starting from 'first_id'.
+*/
+
+template<class SequenceType>
+size_type
+insertText(DynamicGBWT& gbwt, const text_type& text, size_type first_id, std::vector<node_type>* touched)
+{
+  std::vector<SequenceType> seqs;
+  bool seq_start = true;
+  for(size_type i = 0; i < text.size(); i++)
+  {
+    if(seq_start)
+    {
+      seqs.push_back(SequenceType(text, i, first_id + seqs.size()));
+      seq_start = false;
+    }
+    if(text[i] == ENDMARKER) { seq_start = true; }
+  }
+  return insert(gbwt, seqs, text, touched);
+}
+
+template<class SequenceType>
+size_type
+insertSource(DynamicGBWT& gbwt, CompressedSource& source, size_type from, size_type to, size_type first_id,
+             std::vector<node_type>* touched)
+{
+  std::vector<SequenceType> seqs; seqs.reserve(to - from);
+  for(size_type source_id = from; source_id < to; source_id++)
+  {
+    edge_type start = source.gbwt.endmarker.LF(source_id);
+    seqs.push_back(SequenceType(start.first, first_id + (source_id - from), start.second));
+  }
+  return insert(gbwt, seqs, source, touched);
+}
+
 //------------------------------------------------------------------------------
 
 void
@@ -546,34 +751,35 @@ DynamicGBWT::insertBatch(const text_type& text, size_type start_id)
   }
 
   /*
-    Find the start of each sequence and initialize the sequence objects at the endmarker node.
-    Increase alphabet size and decrease offset if necessary.
+    Count the sequences. Increase alphabet size and decrease offset if necessary.
   */
-  bool seq_start = true;
+  size_type first_id = this->sequences(), new_sequences = 0;
   node_type min_node = (this->empty() ? ~(node_type)0 : this->header.offset + 1);
   node_type max_node = (this->empty() ? 0 : this->sigma() - 1);
-  std::vector<Sequence> seqs;
   for(size_type i = 0; i < text.size(); i++)
   {
-    if(seq_start)
-    {
-      seqs.push_back(Sequence(text, i, this->sequences()));
-      seq_start = false; this->header.sequences++;
-    }
-    if(text[i] == ENDMARKER) { seq_start = true; }
+    if(text[i] == ENDMARKER) { new_sequences++; }
     else { min_node = std::min(text[i], min_node); }
     max_node = std::max(text[i], max_node);
   }
   if(Verbosity::level >= Verbosity::EXTENDED)
   {
     std::cerr << "DynamicGBWT::insert(): Inserting sequences " << start_id
-              << " to " << (start_id + seqs.size() - 1) << std::endl;
+              << " to " << (start_id + new_sequences - 1) << std::endl;
   }
   if(max_node == 0) { min_node = 1; } // No real nodes, setting offset to 0.
   this->resize(min_node - 1, max_node + 1);
-
-  // Insert the sequences and sort the outgoing edges.
-  size_type iterations = gbwt::insert(*this, seqs, text);
+  this->header.sequences += new_sequences;
+
+  // Insert the sequences with packed iterators if possible and publish a new snapshot if necessary.
+  bool packed = fitsPacked(std::max(std::max(this->sigma(), this->sequences()), this->size() + text.size()));
+  bool snapshots = this->snapshotsEnabled();
+  std::vector<node_type> touched;
+  size_type iterations = (packed ?
+    insertText<PackedSequence>(*this, text, first_id, (snapshots ? &touched : nullptr)) :
+    insertText<Sequence>(*this, text, first_id, (snapshots ? &touched : nullptr)));
+  this->extendEndmarker();
+  if(snapshots) { this->publish(touched); }
   if(Verbosity::level >= Verbosity::EXTENDED)
   {
     double seconds = readTimer() - start;
@@ -648,6 +854,126 @@ DynamicGBWT::insert(text_buffer_type& text, size_type batch_size)
 
 //------------------------------------------------------------------------------
 
+/*
+  Build the record for 'curr' from the sequences visiting it, given in BWT order as
+  (sequence id, text position) pairs. The sequences are appended to the buckets of
+  the successor nodes in the same order. Because the predecessors are processed in
+  increasing order, each bucket ends up in BWT order.
+*/
+
+void
+lockstepRecord(DynamicGBWT& gbwt, node_type curr, const text_type& text, const std::vector<size_type>& starts,
+               const std::vector<std::pair<size_type, size_type>>& visits,
+               std::vector<std::vector<std::pair<size_type, size_type>>>& buckets)
+{
+  DynamicRecord& current = gbwt.record(curr);
+  RunMerger new_body(0);
+  OutrankIndex index;
+  for(size_type offset = 0; offset < visits.size(); offset++)
+  {
+    size_type id = visits[offset].first, pos = visits[offset].second;
+    node_type next = (curr == ENDMARKER ? text[pos] : text[pos + 1]);
+    rank_type outrank = index.edgeTo(current, next);
+    if(outrank >= current.outdegree())
+    {
+      index.addEdge(current, next);
+      new_body.addEdge();
+    }
+    size_type iteration = (curr == ENDMARKER ? 1 : pos - starts[id] + 2);
+    if(iteration % DynamicGBWT::SAMPLE_INTERVAL == 0 || next == ENDMARKER)
+    {
+      current.ids.push_back(sample_type(offset, id));
+    }
+    new_body.insert(outrank);
+    if(next != ENDMARKER)
+    {
+      DynamicRecord& successor = gbwt.record(next);
+      if(successor.incoming.empty() || successor.incoming.back().first != curr)
+      {
+        successor.incoming.push_back(edge_type(curr, 0));
+      }
+      successor.setCount(successor.indegree() - 1, successor.incoming.back().second + 1);
+      buckets[gbwt.toComp(next)].push_back(std::make_pair(id, (curr == ENDMARKER ? pos : pos + 1)));
+    }
+  }
+  swapBody(current, new_body);
+  gbwt.header.size += visits.size();
+}
+
+bool
+DynamicGBWT::insertLockstep(const text_type& text)
+{
+  double start = readTimer();
+
+  if(!(this->empty()) || this->sequences() > 0) { return false; }
+  if(text.empty()) { return true; }
+  if(text[text.size() - 1] != ENDMARKER)
+  {
+    std::cerr << "DynamicGBWT::insertLockstep(): The text must end with an endmarker" << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+
+  // Find the start of each sequence and check that the sequences are increasing.
+  std::vector<size_type> starts;
+  node_type min_node = ~(node_type)0, max_node = 0;
+  for(size_type i = 0; i < text.size(); i++)
+  {
+    if(i == 0 || text[i - 1] == ENDMARKER) { starts.push_back(i); }
+    else if(text[i] != ENDMARKER && text[i] <= text[i - 1]) { return false; }
+    if(text[i] != ENDMARKER) { min_node = std::min(text[i], min_node); }
+    max_node = std::max(text[i], max_node);
+  }
+  if(max_node == 0) { min_node = 1; } // No real nodes, setting offset to 0.
+  this->resize(min_node - 1, max_node + 1);
+  this->header.sequences = starts.size();
+
+  // Build the records in node order. Each bucket is released after use.
+  std::vector<std::vector<std::pair<size_type, size_type>>> buckets(this->effective());
+  std::unordered_map<node_type, OutrankIndex> indexes; // For predecessors with many outgoing edges.
+  for(size_type id = 0; id < starts.size(); id++) { buckets[0].push_back(std::make_pair(id, starts[id])); }
+  for(comp_type comp = 0; comp < this->effective(); comp++)
+  {
+    node_type curr = this->toNode(comp);
+    if(comp > 0)  // Rebuild the offsets in the outgoing edges of the predecessors.
+    {
+      size_type offset = 0;
+      for(edge_type inedge : this->bwt[comp].incoming)
+      {
+        DynamicRecord& predecessor = this->record(inedge.first);
+        rank_type outrank = (predecessor.outdegree() <= SMALL_OUTDEGREE ?
+                             predecessor.edgeTo(curr) :
+                             indexes[inedge.first].edgeTo(predecessor, curr));
+        predecessor.setOffset(outrank, offset);
+        offset += inedge.second;
+      }
+    }
+    lockstepRecord(*this, curr, text, starts, buckets[comp], buckets);
+    std::vector<std::pair<size_type, size_type>>().swap(buckets[comp]);
+  }
+
+  // Finally sort the outgoing edges.
+  this->recode();
+  this->extendEndmarker();
+
+  if(this->snapshotsEnabled())
+  {
+    std::vector<node_type> touched;
+    for(comp_type comp = 0; comp < this->effective(); comp++) { touched.push_back(this->toNode(comp)); }
+    this->publish(touched);
+  }
+
+  if(Verbosity::level >= Verbosity::BASIC)
+  {
+    double seconds = readTimer() - start;
+    std::cerr << "DynamicGBWT::insertLockstep(): Inserted " << this->sequences()
+              << " sequences of total length " << text.size()
+              << " in " << seconds << " seconds" << std::endl;
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
 void
 DynamicGBWT::merge(const GBWT& source, size_type batch_size)
 {
@@ -666,30 +992,29 @@ DynamicGBWT::merge(const GBWT& source, size_type batch_size)
   if(batch_size == 0) { batch_size = source.sequences(); }
   this->resize(source.header.offset, source.sigma());
 
-  // Insert the sequences in batches.
-  const CompressedRecord endmarker = source.record(ENDMARKER);
-  CompressedRecordIterator iter(endmarker);
-  size_type source_id = 0, run_offset = 0;
+  // Insert the sequences in batches, using packed iterators if possible.
+  CompressedSource compressed(source);
+  bool packed = fitsPacked(std::max(std::max(this->sigma(), this->sequences() + source.sequences()),
+                                    this->size() + source.size()));
+  size_type source_id = 0;
   while(source_id < source.sequences())
   {
     double batch_start = readTimer();
     size_type limit = std::min(source_id + batch_size, source.sequences());
-    std::vector<Sequence> seqs; seqs.reserve(limit - source_id);
-    while(source_id < limit)  // Create the new sequence iterators.
-    {
-      if(run_offset >= iter->second) { ++iter; run_offset = 0; }
-      else
-      {
-        seqs.push_back(Sequence(endmarker.successor(iter->first), this->sequences(), source_id));
-        this->header.sequences++; source_id++; run_offset++;
-      }
-    }
     if(Verbosity::level >= Verbosity::EXTENDED)
     {
-      std::cerr << "DynamicGBWT::merge(): Inserting sequences " << (source_id - seqs.size())
-                << " to " << (source_id - 1) << std::endl;
+      std::cerr << "DynamicGBWT::merge(): Inserting sequences " << source_id
+                << " to " << (limit - 1) << std::endl;
     }
-    size_type iterations = gbwt::insert(*this, seqs, source);
+    size_type first_id = this->sequences();
+    this->header.sequences += limit - source_id;
+    bool snapshots = this->snapshotsEnabled();
+    std::vector<node_type> touched;
+    size_type iterations = (packed ?
+      insertSource<PackedSequence>(*this, compressed, source_id, limit, first_id, (snapshots ? &touched : nullptr)) :
+      insertSource<Sequence>(*this, compressed, source_id, limit, first_id, (snapshots ? &touched : nullptr)));
+    source_id = limit;
+    if(snapshots) { this->publish(touched); }
     if(Verbosity::level >= Verbosity::EXTENDED)
     {
       double seconds = readTimer() - batch_start;
@@ -699,6 +1024,7 @@ DynamicGBWT::merge(const GBWT& source, size_type batch_size)
 
   // Finally sort the outgoing edges.
   this->recode();
+  this->extendEndmarker();
 
   if(Verbosity::level >= Verbosity::BASIC)
   {
@@ -710,6 +1036,86 @@ DynamicGBWT::merge(const GBWT& source, size_type batch_size)
 
 //------------------------------------------------------------------------------
 
+void
+DynamicGBWT::enableSnapshots()
+{
+  std::shared_ptr<GBWTSnapshot> next(new GBWTSnapshot());
+  next->header = this->header;
+  next->bwt.resize(this->effective());
+  #pragma omp parallel for num_threads(this->threads()) schedule(dynamic, 1024)
+  for(comp_type comp = 0; comp < this->effective(); comp++)
+  {
+    next->bwt[comp] = GBWTSnapshot::copyRecord(this->bwt[comp]);
+  }
+  std::atomic_store(&(this->current_snapshot), std::shared_ptr<const GBWTSnapshot>(next));
+}
+
+void
+DynamicGBWT::disableSnapshots()
+{
+  std::atomic_store(&(this->current_snapshot), std::shared_ptr<const GBWTSnapshot>());
+}
+
+std::shared_ptr<const GBWTSnapshot>
+DynamicGBWT::snapshot() const
+{
+  return std::atomic_load(&(this->current_snapshot));
+}
+
+std::future<bool>
+DynamicGBWT::storeSnapshot(const std::string& filename)
+{
+  if(!(this->snapshotsEnabled())) { this->enableSnapshots(); }
+  std::shared_ptr<const GBWTSnapshot> current = this->snapshot();
+  return std::async(std::launch::async, [current, filename]()
+  {
+    return gbwt::storeSnapshot(*current, filename);
+  });
+}
+
+void
+DynamicGBWT::publish(std::vector<node_type>& touched)
+{
+  std::shared_ptr<const GBWTSnapshot> previous = this->snapshot();
+  if(previous == nullptr) { return; }
+
+  // The offsets in the outgoing edges of the predecessors may also have changed.
+  removeDuplicates(touched, false);
+  size_type original_size = touched.size();
+  for(size_type i = 0; i < original_size; i++)
+  {
+    for(edge_type inedge : this->record(touched[i]).incoming) { touched.push_back(inedge.first); }
+  }
+  removeDuplicates(touched, false);
+
+  // Share the unmodified records with the previous snapshot. The alphabet may have changed.
+  std::shared_ptr<GBWTSnapshot> next(new GBWTSnapshot());
+  next->header = this->header;
+  next->bwt.resize(this->effective());
+  for(comp_type comp = 0; comp < this->effective(); comp++)
+  {
+    node_type node = this->toNode(comp);
+    if(previous->contains(node) && previous->toComp(node) < previous->bwt.size())
+    {
+      next->bwt[comp] = previous->bwt[previous->toComp(node)];
+    }
+    else { next->bwt[comp] = GBWTSnapshot::emptyRecord(); }
+  }
+  #pragma omp parallel for num_threads(this->threads()) schedule(dynamic, 1024)
+  for(size_type i = 0; i < touched.size(); i++)
+  {
+    next->bwt[this->toComp(touched[i])] = GBWTSnapshot::copyRecord(this->record(touched[i]));
+  }
+
+  std::atomic_store(&(this->current_snapshot), std::shared_ptr<const GBWTSnapshot>(next));
+  if(Verbosity::level >= Verbosity::FULL)
+  {
+    std::cerr << "DynamicGBWT::publish(): Copied " << touched.size() << " records" << std::endl;
+  }
+}
+
+//------------------------------------------------------------------------------
+
 size_type
 DynamicGBWT::tryLocate(node_type node, size_type i) const
 {
@@ -722,6 +1128,218 @@ DynamicGBWT::tryLocate(node_type node, size_type i) const
   return invalid_sequence();
 }
 
+edge_type
+DynamicGBWT::inverseLF(node_type to, size_type i) const
+{
+  if(to == ENDMARKER) { return invalid_edge(); }
+
+  size_type offset = 0;
+  for(edge_type inedge : this->record(to).incoming)
+  {
+    if(offset + inedge.second > i)
+    {
+      size_type result = this->record(inedge.first).select(i - offset, to);
+      if(result == invalid_offset()) { return invalid_edge(); }
+      return edge_type(inedge.first, result);
+    }
+    offset += inedge.second;
+  }
+
+  return invalid_edge();
+}
+
+std::vector<node_type>
+DynamicGBWT::extract(size_type sequence) const
+{
+  std::vector<node_type> result;
+  edge_type position = this->endmarker.LF(sequence);
+  while(position.first != ENDMARKER)
+  {
+    result.push_back(position.first);
+    position = this->LF(position);
+  }
+  return result;
+}
+
+//------------------------------------------------------------------------------
+
+GBWTBuilder::GBWTBuilder(DynamicGBWT& index, size_type batch) :
+  gbwt(index), batch_size(batch), start_sequences(index.sequences()),
+  head(nullptr), submitted(0), completed(0),
+  flush_requested(false), stopping(false), finished(false)
+{
+  if(this->batch_size == 0) { this->batch_size = DynamicGBWT::INSERT_BATCH_SIZE; }
+  this->worker = std::thread(&GBWTBuilder::run, this);
+}
+
+GBWTBuilder::~GBWTBuilder()
+{
+  this->finish();
+}
+
+void
+GBWTBuilder::insert(const std::vector<node_type>& sequence)
+{
+  this->push(new Node { sequence, nullptr });
+}
+
+void
+GBWTBuilder::insert(std::vector<node_type>&& sequence)
+{
+  this->push(new Node { std::move(sequence), nullptr });
+}
+
+void
+GBWTBuilder::push(Node* node)
+{
+  for(node_type value : node->sequence)
+  {
+    if(value == ENDMARKER)
+    {
+      std::cerr << "GBWTBuilder::insert(): The sequence must not contain endmarkers" << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+  }
+
+  // The node may be consumed as soon as it is in the stack, so we keep the old head.
+  Node* previous = this->head.load(std::memory_order_relaxed);
+  do { node->next = previous; }
+  while(!(this->head.compare_exchange_weak(previous, node, std::memory_order_release, std::memory_order_relaxed)));
+  this->submitted++;
+
+  // Only a push to an empty stack can change the predicate of the background thread.
+  // Taking the mutex ensures that the thread is either waiting or has not checked yet.
+  if(previous == nullptr)
+  {
+    { std::lock_guard<std::mutex> lock(this->mtx); }
+    this->work_available.notify_one();
+  }
+}
+
+void
+GBWTBuilder::flush()
+{
+  {
+    std::lock_guard<std::mutex> lock(this->mtx);
+    this->flush_requested = true;
+  }
+  this->work_available.notify_one();
+}
+
+void
+GBWTBuilder::wait()
+{
+  size_type target = this->submitted;
+  this->flush();
+  std::unique_lock<std::mutex> lock(this->mtx);
+  this->work_done.wait(lock, [this, target]() { return (this->completed >= target || this->finished); });
+}
+
+void
+GBWTBuilder::finish()
+{
+  {
+    std::unique_lock<std::mutex> lock(this->mtx);
+    if(this->stopping) // Another caller is joining the background thread.
+    {
+      this->work_done.wait(lock, [this]() { return this->finished; });
+      return;
+    }
+    this->stopping = true;
+  }
+  this->work_available.notify_one();
+  this->worker.join();
+  this->gbwt.recode();
+
+  std::lock_guard<std::mutex> lock(this->mtx);
+  this->finished = true;
+  this->work_done.notify_all();
+}
+
+size_type
+GBWTBuilder::inserted() const
+{
+  std::lock_guard<std::mutex> lock(this->mtx);
+  return this->completed;
+}
+
+/*
+  The background thread takes the entire stack at once and keeps the sequences in
+  insertion order. It inserts a batch when it has enough nodes or when a flush has
+  been requested. The producers only take the mutex when they push to an empty stack.
+*/
+
+void
+GBWTBuilder::run()
+{
+  std::vector<Node*> pending;
+  size_type pending_nodes = 0;
+  while(true)
+  {
+    bool flushing = false, stop = false;
+    {
+      std::unique_lock<std::mutex> lock(this->mtx);
+      this->work_available.wait(lock, [this]()
+      {
+        return (this->head.load(std::memory_order_relaxed) != nullptr || this->flush_requested || this->stopping);
+      });
+      flushing = this->flush_requested; stop = this->stopping;
+      this->flush_requested = false;
+    }
+
+    // Reverse the stack into insertion order.
+    Node* node = this->head.exchange(nullptr, std::memory_order_acquire);
+    size_type first = pending.size();
+    for(; node != nullptr; node = node->next)
+    {
+      pending.push_back(node);
+      pending_nodes += node->sequence.size() + 1;
+    }
+    std::reverse(pending.begin() + first, pending.end());
+
+    if(!(pending.empty()) && (pending_nodes >= this->batch_size || flushing || stop))
+    {
+      this->insertBatch(pending);
+      pending_nodes = 0;
+    }
+    else if(pending.empty() && flushing)
+    {
+      std::lock_guard<std::mutex> lock(this->mtx);
+      this->work_done.notify_all();
+    }
+    if(stop && this->head.load() == nullptr) { return; }
+  }
+}
+
+void
+GBWTBuilder::insertBatch(std::vector<Node*>& batch)
+{
+  size_type total_length = 0;
+  node_type max_node = 0;
+  for(const Node* node : batch)
+  {
+    total_length += node->sequence.size() + 1;
+    for(node_type value : node->sequence) { max_node = std::max(value, max_node); }
+  }
+
+  text_type text(total_length, 0, bit_length(max_node));
+  size_type offset = 0;
+  for(Node* node : batch)
+  {
+    for(node_type value : node->sequence) { text[offset] = value; offset++; }
+    text[offset] = ENDMARKER; offset++;
+    delete node;
+  }
+  size_type sequences = batch.size();
+  batch.clear();
+
+  this->gbwt.insertBatch(text, this->gbwt.sequences() - this->start_sequences);
+
+  std::lock_guard<std::mutex> lock(this->mtx);
+  this->completed += sequences;
+  this->work_done.notify_all();
+}
+
 //------------------------------------------------------------------------------
 
 void
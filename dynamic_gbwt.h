@@ -26,6 +26,12 @@
 #define GBWT_DYNAMIC_GBWT_H
 
 #include "gbwt.h"
+#include "snapshot.h"
+
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <thread>
 
 namespace gbwt
 {
@@ -77,6 +83,16 @@ public:
   */
   void insert(text_buffer_type& text, size_type batch_size = INSERT_BATCH_SIZE);
 
+  /*
+    Lockstep construction for an empty GBWT, assuming that the node identifiers are
+    increasing in each sequence, as with full haplotypes in a topologically sorted DAG.
+    The records are built in node order as in the PBWT: the sequences visiting a node
+    are distributed into the buckets of the successor nodes without sorting. The result
+    is the same as with insert(). Returns false without modifying the GBWT if the GBWT
+    is not empty or a sequence is not increasing.
+  */
+  bool insertLockstep(const text_type& text);
+
   /*
     Insert the sequences from the other GBWT into this. Use batch size 0 to insert all
     sequences at once.
@@ -85,6 +101,42 @@ public:
   */
   void merge(const GBWT& source, size_type batch_size = MERGE_BATCH_SIZE);
 
+//------------------------------------------------------------------------------
+
+  /*
+    Snapshots for concurrent queries during construction. When snapshots are enabled,
+    each insertion batch ends by publishing a new snapshot. The snapshot shares the
+    records that the batch did not modify with the previous snapshot. Enabling the
+    snapshots copies the entire index.
+
+    snapshot() can be called from any thread at any time. It returns an empty pointer
+    if snapshots are not enabled. The other member functions must not be called
+    concurrently with insertion or merging.
+  */
+  void enableSnapshots();
+  void disableSnapshots();
+  std::shared_ptr<const GBWTSnapshot> snapshot() const;
+  inline bool snapshotsEnabled() const { return (this->snapshot() != nullptr); }
+
+  /*
+    Write the current snapshot as a compressed GBWT in a background thread using
+    storeSnapshot(). Insertion can continue while the file is being written. Enables
+    snapshots if necessary, which must not happen concurrently with insertion. The
+    future becomes ready with the return value of storeSnapshot().
+  */
+  std::future<bool> storeSnapshot(const std::string& filename);
+
+//------------------------------------------------------------------------------
+
+  /*
+    Thread budget for construction. Sorting the sequences and the other parallel steps
+    of insertion and merging use at most this many threads without changing the global
+    OpenMP settings, so several GBWTs can be built concurrently in the same process, each
+    with its own share of the cores. The default is omp_get_max_threads() at creation.
+  */
+  inline size_type threads() const { return this->thread_budget; }
+  inline void setThreads(size_type threads) { this->thread_budget = std::max(threads, (size_type)1); }
+
 //------------------------------------------------------------------------------
 
   inline size_type size() const { return this->header.size; }
@@ -100,6 +152,7 @@ public:
   }
 
   inline comp_type toComp(node_type node) const { return (node == 0 ? node : node - this->header.offset); }
+  inline node_type toNode(comp_type comp) const { return (comp == 0 ? comp : comp + this->header.offset); }
 
   size_type runs() const;
   size_type samples() const;
@@ -114,13 +167,14 @@ public:
   // On error: invalid_edge().
   inline edge_type LF(node_type from, size_type i) const
   {
+    if(from == ENDMARKER) { return this->endmarker.LF(i); }
     return this->record(from).LF(i);
   }
 
   // On error: invalid_edge().
   inline edge_type LF(edge_type position) const
   {
-    return this->record(position.first).LF(position.second);
+    return this->LF(position.first, position.second);
   }
 
   // On error: invalid_offset().
@@ -145,6 +199,18 @@ public:
   size_type tryLocate(node_type node, size_type i) const;
   inline size_type tryLocate(edge_type position) const { return this->tryLocate(position.first, position.second); }
 
+  /*
+    Inverse LF: returns (from, j) such that LF(from, j) == (to, i). The endmarker does
+    not have incoming edges.
+  */
+
+  // On error: invalid_edge().
+  edge_type inverseLF(node_type to, size_type i) const;
+  inline edge_type inverseLF(edge_type position) const { return this->inverseLF(position.first, position.second); }
+
+  // Returns the sequence without the endmarker or an empty sequence if there is no such sequence.
+  std::vector<node_type> extract(size_type sequence) const;
+
 //------------------------------------------------------------------------------
 
   /*
@@ -167,9 +233,20 @@ public:
   GBWTHeader                 header;
   std::vector<DynamicRecord> bwt;
 
+  // Extended with the new sequences after each insertion batch and merge.
+  EndmarkerIndex             endmarker;
+
+  // The latest published snapshot. Only access with std::atomic_load/store.
+  std::shared_ptr<const GBWTSnapshot> current_snapshot;
+
+  // See threads(). Not serialized.
+  size_type                  thread_budget;
+
 //------------------------------------------------------------------------------
 
 private:
+  friend class GBWTBuilder;
+
   void copy(const DynamicGBWT& source);
 
   // Change offset or alphabet size if the new values are beyond the current values.
@@ -182,11 +259,23 @@ private:
   */
   void recode();
 
+  // Rebuild the endmarker index after loading the endmarker record.
+  void rebuildEndmarker();
+
+  // Add the sequences appended to the endmarker record after each insertion batch and merge.
+  void extendEndmarker();
+
   /*
     Insert a batch of sequences with ids (in the current input) starting from 'start_id'.
   */
   void insertBatch(const text_type& text, size_type start_id = 0);
 
+  /*
+    Publish a new snapshot after modifying the records of the given nodes. The
+    predecessors of the nodes are added automatically.
+  */
+  void publish(std::vector<node_type>& touched);
+
 //------------------------------------------------------------------------------
 
 }; // class DynamicGBWT
@@ -195,6 +284,71 @@ void printStatistics(const DynamicGBWT& gbwt, const std::string& name);
 
 //------------------------------------------------------------------------------
 
+/*
+  Online construction: insert individual sequences from any number of threads. The
+  sequences go to a lock-free queue, and a background thread inserts them into the
+  index in batches of approximately 'batch_size' nodes. The sequences receive
+  identifiers in the order the background thread takes them from the queue.
+
+  The index must not be used while the builder is active, except for snapshot().
+  After finish(), the index is complete and the builder cannot be used anymore.
+*/
+
+class GBWTBuilder
+{
+public:
+  typedef DynamicGBWT::size_type size_type;
+
+  explicit GBWTBuilder(DynamicGBWT& gbwt, size_type batch_size = DynamicGBWT::INSERT_BATCH_SIZE);
+  ~GBWTBuilder(); // Calls finish().
+
+  // Thread-safe. The sequence must not contain endmarkers.
+  void insert(const std::vector<node_type>& sequence);
+  void insert(std::vector<node_type>&& sequence);
+
+  // Insert the queued sequences without waiting for a full batch.
+  void flush();
+
+  // Flush and wait until the sequences inserted before the call are in the index.
+  void wait();
+
+  // Wait for all sequences, sort the outgoing edges, and stop the background thread.
+  void finish();
+
+  // Number of sequences the builder has inserted into the index.
+  size_type inserted() const;
+
+private:
+  struct Node
+  {
+    std::vector<node_type> sequence;
+    Node*                  next;
+  };
+
+  DynamicGBWT&             gbwt;
+  size_type                batch_size;
+  size_type                start_sequences;
+
+  std::atomic<Node*>       head;      // Stack of queued sequences, latest first.
+  std::atomic<size_type>   submitted; // Incremented after pushing to the stack.
+  size_type                completed; // Protected by the mutex.
+  // Protected by the mutex. Only the finish() call that sets 'stopping' joins the thread.
+  bool                     flush_requested, stopping, finished;
+
+  mutable std::mutex       mtx;
+  std::condition_variable  work_available, work_done;
+  std::thread              worker;
+
+  GBWTBuilder(const GBWTBuilder&) = delete;
+  GBWTBuilder& operator=(const GBWTBuilder&) = delete;
+
+  void push(Node* node);
+  void run();
+  void insertBatch(std::vector<Node*>& batch);
+};
+
+//------------------------------------------------------------------------------
+
 } // namespace gbwt
 
 #endif // GBWT_DYNAMIC_GBWT_H
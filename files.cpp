@@ -68,7 +68,7 @@ GBWTHeader::load(std::istream& in)
 bool
 GBWTHeader::check(uint32_t expected_version) const
 {
-  return (this->tag == TAG && this->version == expected_version && this->flags == 0);
+  return (this->tag == TAG && this->version == expected_version && (this->flags & ~FLAG_MASK) == 0);
 }
 
 bool
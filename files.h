@@ -41,6 +41,9 @@ namespace gbwt
 
   Version 0:
   - Current version.
+
+  Flags:
+  - FLAG_INCOMING: The index contains the incoming edges of each record.
 */
 
 struct GBWTHeader
@@ -59,6 +62,9 @@ struct GBWTHeader
   const static std::uint32_t VERSION = 0;
   const static std::uint32_t MIN_VERSION = 0;
 
+  const static std::uint64_t FLAG_INCOMING = 0x0001;
+  const static std::uint64_t FLAG_MASK     = 0x0001;
+
   GBWTHeader();
 
   size_type serialize(std::ostream& out, sdsl::structure_tree_node* v = nullptr, std::string name = "") const;
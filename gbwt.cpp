@@ -50,6 +50,453 @@ GBWT::~GBWT()
 {
 }
 
+//------------------------------------------------------------------------------
+
+/*
+  Merging compressed GBWTs. Within each record, the merged order is an interleaving of
+  the orders in the sources. For each position of the second source, we compute the
+  number of positions of the first source before it in the merged record. Because LF()
+  maps positions from the same predecessor in order, the rank in the successor is
+
+    (positions of the first source in 'to' from predecessors before 'from')
+    + (positions of the first source going to 'to' before the rank in 'from'),
+
+  which is first.LF(from, rank, to) when the edge exists. The ranks are computed by
+  advancing the sequences of the second source in lockstep. In each round, the positions
+  are sorted by node and offset, and each record is decoded once for all positions in it.
+  The ranks are stored as one interleave bitvector per record, with a bit per merged
+  position marking the positions of the second source. Then the records are merged in
+  parallel, and the compressed structures are built directly from them.
+*/
+
+struct MergeSource
+{
+  explicit MergeSource(const GBWT& source);
+
+  inline bool contains(node_type node) const
+  {
+    return (this->index.contains(node) && this->index.toComp(node) < this->index.effective());
+  }
+
+  inline size_type size(node_type node) const
+  {
+    return (this->contains(node) ? this->sizes[this->index.toComp(node)] : 0);
+  }
+
+  // Number of positions in the record of 'to' with predecessors before 'from'.
+  size_type prefix(node_type from, node_type to) const;
+
+  // Returns (predecessor, path count) for each incoming edge to the node.
+  std::vector<edge_type> incomingEdges(node_type node) const;
+
+  // Returns the outgoing edges and the body of the record.
+  void decode(node_type node, std::vector<edge_type>& outgoing, std::vector<run_type>& body) const;
+
+  const GBWT&                           index;
+  std::vector<size_type>                sizes;
+  std::vector<std::vector<edge_type>>   incoming; // (predecessor, edge offset) for each record.
+  std::vector<std::vector<sample_type>> samples;
+};
+
+MergeSource::MergeSource(const GBWT& source) :
+  index(source), sizes(source.effective(), 0), incoming(source.effective())
+{
+  #pragma omp parallel for schedule(dynamic, 1024)
+  for(GBWT::comp_type comp = 0; comp < source.effective(); comp++)
+  {
+    this->sizes[comp] = source.record(source.toNode(comp)).size();
+  }
+
+  for(GBWT::comp_type comp = 0; comp < source.effective(); comp++)
+  {
+    node_type node = source.toNode(comp);
+    CompressedRecord record = source.record(node);
+    for(edge_type outedge : record.outgoing)
+    {
+      if(outedge.first == ENDMARKER) { continue; }
+      this->incoming[source.toComp(outedge.first)].push_back(edge_type(node, outedge.second));
+    }
+  }
+
+  this->samples = source.da_samples.decompress();
+  this->samples.resize(source.effective());
+}
+
+size_type
+MergeSource::prefix(node_type from, node_type to) const
+{
+  if(!(this->contains(to))) { return 0; }
+  const std::vector<edge_type>& edges = this->incoming[this->index.toComp(to)];
+  auto iter = std::lower_bound(edges.begin(), edges.end(), from,
+                               [](edge_type edge, node_type node) -> bool { return (edge.first < node); });
+  return (iter == edges.end() ? this->size(to) : iter->second);
+}
+
+std::vector<edge_type>
+MergeSource::incomingEdges(node_type node) const
+{
+  std::vector<edge_type> result;
+  if(node == ENDMARKER || !(this->contains(node))) { return result; }
+  const std::vector<edge_type>& edges = this->incoming[this->index.toComp(node)];
+  for(size_type i = 0; i < edges.size(); i++)
+  {
+    size_type limit = (i + 1 < edges.size() ? edges[i + 1].second : this->size(node));
+    result.push_back(edge_type(edges[i].first, limit - edges[i].second));
+  }
+  return result;
+}
+
+void
+MergeSource::decode(node_type node, std::vector<edge_type>& outgoing, std::vector<run_type>& body) const
+{
+  outgoing.clear(); body.clear();
+  if(!(this->contains(node))) { return; }
+  CompressedRecord record = this->index.record(node);
+  outgoing = record.outgoing;
+  if(record.outdegree() > 0)
+  {
+    for(CompressedRecordIterator iter(record); !(iter.end()); ++iter) { body.push_back(*iter); }
+  }
+}
+
+//------------------------------------------------------------------------------
+
+struct MergePosition
+{
+  node_type node;
+  size_type offset; // In the record of the second source.
+  size_type rank;   // Positions of the first source before this position in the merged record.
+
+  inline bool operator<(const MergePosition& another) const
+  {
+    return (this->node < another.node || (this->node == another.node && this->offset < another.offset));
+  }
+};
+
+/*
+  Advances the positions in the same node to the next node. The positions are sorted by
+  offset, and hence also by rank.
+*/
+
+void
+advancePositions(const MergeSource& first, const GBWT& second,
+                 std::vector<MergePosition>::iterator begin, std::vector<MergePosition>::iterator end)
+{
+  node_type node = begin->node;
+
+  // The positions of the first source precede those of the second source in the endmarker.
+  if(node == ENDMARKER)
+  {
+    for(auto pos = begin; pos != end; ++pos)
+    {
+      edge_type next = second.endmarker.LF(pos->offset);
+      pos->node = next.first; pos->offset = next.second;
+      if(pos->node != ENDMARKER) { pos->rank = first.index.endmarker.count(pos->node); }
+    }
+    return;
+  }
+
+  // LF() in the second source.
+  {
+    CompressedRecord record = second.record(node);
+    CompressedRecordFullIterator iter(record);
+    for(auto pos = begin; pos != end; ++pos)
+    {
+      while(iter.offset() <= pos->offset) { ++iter; }
+      edge_type next = iter.edge(); next.second -= (iter.offset() - pos->offset);
+      pos->node = next.first; pos->offset = next.second;
+    }
+  }
+
+  // The rank in the next node.
+  CompressedRecord record = (first.contains(node) ? first.index.record(node) : CompressedRecord());
+  if(record.outdegree() == 0)
+  {
+    for(auto pos = begin; pos != end; ++pos)
+    {
+      if(pos->node != ENDMARKER) { pos->rank = first.prefix(node, pos->node); }
+    }
+    return;
+  }
+  CompressedRecordFullIterator iter(record);
+  for(auto pos = begin; pos != end; ++pos)
+  {
+    if(pos->node == ENDMARKER) { continue; }
+    rank_type outrank = record.edgeTo(pos->node);
+    if(outrank >= record.outdegree()) { pos->rank = first.prefix(node, pos->node); continue; }
+    while(iter.offset() < pos->rank) { ++iter; }
+    size_type result = iter.rank(outrank);
+    if(iter->first == outrank && iter.offset() > pos->rank) { result -= iter.offset() - pos->rank; }
+    pos->rank = result;
+  }
+}
+
+//------------------------------------------------------------------------------
+
+void
+appendRun(std::vector<run_type>& body, rank_type outrank, size_type length)
+{
+  if(length == 0) { return; }
+  if(!(body.empty()) && body.back().first == outrank) { body.back().second += length; }
+  else { body.push_back(run_type(outrank, length)); }
+}
+
+// Returns the first set bit at or after offset i or the size of the bitvector.
+size_type
+nextOne(const sdsl::bit_vector& bv, size_type i)
+{
+  while(i < bv.size())
+  {
+    size_type length = std::min(WORD_BITS, bv.size() - i);
+    std::uint64_t word = bv.get_int(i, length);
+    if(word != 0) { return i + sdsl::bits::lo(word); }
+    i += length;
+  }
+  return bv.size();
+}
+
+/*
+  Merges the records of the node. Bit i of 'interleave' is set if offset i of the merged
+  record comes from the second source.
+*/
+
+void
+mergeRecord(const MergeSource& first, const MergeSource& second, node_type node,
+            const sdsl::bit_vector& interleave, std::vector<byte_type>& data,
+            std::vector<sample_type>& samples)
+{
+  std::vector<edge_type> first_outgoing, second_outgoing;
+  std::vector<run_type> first_body, second_body;
+  first.decode(node, first_outgoing, first_body);
+  second.decode(node, second_outgoing, second_body);
+
+  // Merge the outgoing edges. Edges to the endmarker do not have offsets.
+  std::vector<edge_type> outgoing;
+  std::vector<rank_type> first_map(first_outgoing.size()), second_map(second_outgoing.size());
+  for(size_type i = 0, j = 0; i < first_outgoing.size() || j < second_outgoing.size(); )
+  {
+    node_type to = (j >= second_outgoing.size() ||
+                    (i < first_outgoing.size() && first_outgoing[i].first < second_outgoing[j].first)
+                    ? first_outgoing[i].first : second_outgoing[j].first);
+    if(i < first_outgoing.size() && first_outgoing[i].first == to) { first_map[i] = outgoing.size(); i++; }
+    if(j < second_outgoing.size() && second_outgoing[j].first == to) { second_map[j] = outgoing.size(); j++; }
+    size_type offset = (to == ENDMARKER ? 0 : first.prefix(node, to) + second.prefix(node, to));
+    outgoing.push_back(edge_type(to, offset));
+  }
+
+  // Interleave the bodies and the samples.
+  const std::vector<sample_type> no_samples;
+  const std::vector<sample_type>& first_samples = (first.contains(node) ? first.samples[first.index.toComp(node)] : no_samples);
+  const std::vector<sample_type>& second_samples = (second.contains(node) ? second.samples[second.index.toComp(node)] : no_samples);
+  auto first_sample = first_samples.begin(), second_sample = second_samples.begin();
+  samples.clear();
+  std::vector<run_type> body;
+  size_type first_run = 0, first_done = 0, first_run_left = (first_body.empty() ? 0 : first_body.front().second);
+  size_type second_done = 0;
+  auto copyFirst = [&](size_type limit)
+  {
+    for(; first_sample != first_samples.end() && first_sample->first < limit; ++first_sample)
+    {
+      samples.push_back(sample_type(first_sample->first + second_done, first_sample->second));
+    }
+    while(first_done < limit)
+    {
+      size_type length = std::min(first_run_left, limit - first_done);
+      appendRun(body, first_map[first_body[first_run].first], length);
+      first_done += length; first_run_left -= length;
+      if(first_run_left == 0 && first_run + 1 < first_body.size())
+      {
+        first_run++; first_run_left = first_body[first_run].second;
+      }
+    }
+  };
+  size_type merged_offset = 0;
+  for(run_type run : second_body)
+  {
+    for(size_type k = 0; k < run.second; k++, second_done++, merged_offset++)
+    {
+      merged_offset = nextOne(interleave, merged_offset);
+      copyFirst(merged_offset - second_done);
+      if(second_sample != second_samples.end() && second_sample->first == second_done)
+      {
+        samples.push_back(sample_type(merged_offset, second_sample->second + first.index.sequences()));
+        ++second_sample;
+      }
+      appendRun(body, second_map[run.first], 1);
+    }
+  }
+  copyFirst(first.size(node));
+  RecordArray::encode(data, outgoing, body);
+}
+
+GBWT::GBWT(const GBWT& first, const GBWT& second)
+{
+  double start = readTimer();
+
+  if(second.empty())
+  {
+    this->copy(first);
+    return;
+  }
+
+  // Determine the merged header. See DynamicGBWT::resize().
+  this->header = first.header;
+  this->header.sequences = first.sequences() + second.sequences();
+  this->header.size = first.size() + second.size();
+  if(first.sigma() <= 1 || (second.sigma() > 1 && second.header.offset < first.header.offset))
+  {
+    this->header.offset = second.header.offset;
+  }
+  this->header.alphabet_size = std::max(first.sigma(), second.sigma());
+
+  MergeSource first_source(first), second_source(second);
+
+  // Build the interleave bitvectors by advancing the sequences of the second source.
+  // A position with offset i and rank r in the second source is at offset i + r in the
+  // merged record.
+  std::vector<sdsl::bit_vector> interleave(this->effective());
+  for(comp_type comp = 0; comp < this->effective(); comp++)
+  {
+    node_type node = this->toNode(comp);
+    interleave[comp] = sdsl::bit_vector(first_source.size(node) + second_source.size(node), 0);
+  }
+  std::vector<MergePosition> positions(second.sequences());
+  for(size_type sequence = 0; sequence < second.sequences(); sequence++)
+  {
+    positions[sequence] = { ENDMARKER, sequence, first.sequences() };
+    interleave[0][sequence + first.sequences()] = 1;
+  }
+  size_type iterations = 0;
+  while(!(positions.empty()))
+  {
+    std::vector<size_type> groups;
+    for(size_type i = 0; i < positions.size(); i++)
+    {
+      if(i == 0 || positions[i].node != positions[i - 1].node) { groups.push_back(i); }
+    }
+    groups.push_back(positions.size());
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for(size_type group = 0; group < groups.size() - 1; group++)
+    {
+      auto begin = positions.begin() + groups[group], end = positions.begin() + groups[group + 1];
+      advancePositions(first_source, second, begin, end);
+    }
+    for(const MergePosition& pos : positions) // Different groups may update the same bitvector.
+    {
+      if(pos.node != ENDMARKER) { interleave[this->toComp(pos.node)][pos.offset + pos.rank] = 1; }
+    }
+
+    // Sort the positions and remove the finished sequences.
+    chooseBestSort(positions.begin(), positions.end());
+    size_type head = 0;
+    while(head < positions.size() && positions[head].node == ENDMARKER) { head++; }
+    positions.erase(positions.begin(), positions.begin() + head);
+    iterations++;
+  }
+  if(Verbosity::level >= Verbosity::EXTENDED)
+  {
+    double seconds = readTimer() - start;
+    std::cerr << "GBWT::GBWT(): Computed the interleaving in " << iterations << " iterations and " << seconds << " seconds" << std::endl;
+  }
+
+  // Merge the records.
+  std::vector<std::vector<byte_type>> records(this->effective());
+  std::vector<size_type> sizes(this->effective());
+  std::vector<std::vector<sample_type>> samples(this->effective());
+  std::vector<std::vector<edge_type>> incoming(this->hasIncoming() ? this->effective() : 0);
+  #pragma omp parallel for schedule(dynamic, 1024)
+  for(comp_type comp = 0; comp < this->effective(); comp++)
+  {
+    node_type node = this->toNode(comp);
+    mergeRecord(first_source, second_source, node, interleave[comp], records[comp], samples[comp]);
+    sizes[comp] = first_source.size(node) + second_source.size(node);
+    sdsl::util::clear(interleave[comp]);
+    if(this->hasIncoming())
+    {
+      std::vector<edge_type> first_edges = first_source.incomingEdges(node);
+      std::vector<edge_type> second_edges = second_source.incomingEdges(node);
+      std::vector<edge_type>& result = incoming[comp];
+      for(size_type i = 0, j = 0; i < first_edges.size() || j < second_edges.size(); )
+      {
+        if(j >= second_edges.size() || (i < first_edges.size() && first_edges[i].first < second_edges[j].first))
+        {
+          result.push_back(first_edges[i]); i++;
+        }
+        else if(i >= first_edges.size() || second_edges[j].first < first_edges[i].first)
+        {
+          result.push_back(second_edges[j]); j++;
+        }
+        else
+        {
+          result.push_back(edge_type(first_edges[i].first, first_edges[i].second + second_edges[j].second));
+          i++; j++;
+        }
+      }
+    }
+  }
+
+  // Build the compressed structures.
+  this->bwt = RecordArray(records);
+  std::vector<std::vector<byte_type>>().swap(records);
+  this->da_samples = DASamples(sizes, samples);
+  if(this->hasIncoming()) { this->incoming = IncomingEdges(incoming); }
+  if(this->effective() > 0) { this->endmarker = EndmarkerIndex(this->record(ENDMARKER)); }
+
+  if(Verbosity::level >= Verbosity::BASIC)
+  {
+    double seconds = readTimer() - start;
+    std::cerr << "GBWT::GBWT(): Merged " << first.sequences() << " + " << second.sequences()
+              << " sequences of total length " << this->size() << " in " << seconds << " seconds" << std::endl;
+  }
+}
+
+/*
+  Merges sources [from, to), where to - from >= 2, and stores the result in 'result'.
+  source(i, buffer) returns source i, possibly after loading it into 'buffer'. The
+  subtrees are merged before loading the leaves, and the inputs of each pairwise merge
+  are released after it.
+*/
+template<class SourceFunction>
+void
+mergeSources(SourceFunction& source, size_type from, size_type to, GBWT& result)
+{
+  size_type mid = from + (to - from) / 2;
+  GBWT left, right;
+  if(mid - from > 1) { mergeSources(source, from, mid, left); }
+  if(to - mid > 1) { mergeSources(source, mid, to, right); }
+  const GBWT* left_source = (mid - from > 1 ? &left : source(from, left));
+  const GBWT* right_source = (to - mid > 1 ? &right : source(mid, right));
+
+  GBWT merged(*left_source, *right_source);
+  sdsl::util::clear(left); sdsl::util::clear(right);
+  result.swap(merged);
+}
+
+GBWT::GBWT(const std::vector<const GBWT*>& sources)
+{
+  if(sources.empty()) { return; }
+  if(sources.size() == 1) { this->copy(*(sources.front())); return; }
+  auto source = [&sources](size_type i, GBWT&) -> const GBWT* { return sources[i]; };
+  mergeSources(source, 0, sources.size(), *this);
+}
+
+GBWT::GBWT(const std::vector<std::string>& filenames)
+{
+  auto source = [&filenames](size_type i, GBWT& buffer) -> const GBWT*
+  {
+    if(!sdsl::load_from_file(buffer, filenames[i]))
+    {
+      std::cerr << "GBWT::GBWT(): Cannot load input " << filenames[i] << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+    return &buffer;
+  };
+  if(filenames.empty()) { return; }
+  if(filenames.size() == 1) { source(0, *this); return; }
+  mergeSources(source, 0, filenames.size(), *this);
+}
+
 void
 GBWT::swap(GBWT& another)
 {
@@ -58,6 +505,8 @@ GBWT::swap(GBWT& another)
     this->header.swap(another.header);
     this->bwt.swap(another.bwt);
     this->da_samples.swap(another.da_samples);
+    this->incoming.swap(another.incoming);
+    this->endmarker.swap(another.endmarker);
   }
 }
 
@@ -76,6 +525,8 @@ GBWT::operator=(GBWT&& source)
     this->header = std::move(source.header);
     this->bwt = std::move(source.bwt);
     this->da_samples = std::move(source.da_samples);
+    this->incoming = std::move(source.incoming);
+    this->endmarker = std::move(source.endmarker);
   }
   return *this;
 }
@@ -89,6 +540,10 @@ GBWT::serialize(std::ostream& out, sdsl::structure_tree_node* v, std::string nam
   written_bytes += this->header.serialize(out, child, "header");
   written_bytes += this->bwt.serialize(out, child, "bwt");
   written_bytes += this->da_samples.serialize(out, child, "da_samples");
+  if(this->hasIncoming())
+  {
+    written_bytes += this->incoming.serialize(out, child, "incoming");
+  }
 
   sdsl::structure_tree::add_size(child, written_bytes);
   return written_bytes;
@@ -105,6 +560,9 @@ GBWT::load(std::istream& in)
 
   this->bwt.load(in);
   this->da_samples.load(in);
+  if(this->hasIncoming()) { this->incoming.load(in); }
+  else { this->incoming = IncomingEdges(); }
+  this->endmarker = (this->effective() > 0 ? EndmarkerIndex(this->record(ENDMARKER)) : EndmarkerIndex());
 }
 
 void
@@ -113,6 +571,8 @@ GBWT::copy(const GBWT& source)
   this->header = source.header;
   this->bwt = source.bwt;
   this->da_samples = source.da_samples;
+  this->incoming = source.incoming;
+  this->endmarker = source.endmarker;
 }
 
 //------------------------------------------------------------------------------
@@ -146,6 +606,190 @@ GBWT::locate(node_type node, size_type i) const
   }
 }
 
+/*
+  Batch locate() is software-pipelined, and each stage only uses data prefetched in
+  the previous round:
+
+  1. Index stage: prefetch the record directory entries (or the sd_vector words that
+     select() reads) and the sample index for the record.
+  2. Data stage: compute the record boundaries and prefetch the record. Compute the
+     rank of a sampled record and prefetch the words of its sample range select.
+  3. Sample stage: find the sample range and prefetch the words the sample rank
+     reads. With fused samples, the data stage already prefetched the first probe.
+  4. The query calls tryLocate() and takes the LF() step.
+*/
+
+struct LocateState
+{
+  size_type query;
+  size_type comp, offset;
+  size_type start, limit;
+  size_type sample_rank; // Rank of the record among sampled records + 1, or 0 if not sampled.
+};
+
+// Prefetch the word containing element i of the vector.
+template<class IntVector>
+inline void
+prefetchElement(const IntVector& v, size_type i)
+{
+  __builtin_prefetch(v.data() + ((i * v.width()) >> 6));
+}
+
+/*
+  Prefetch the words of an sd_vector that select(k) reads. The low part is read at
+  index k - 1. The position of the k-th one in the high part is estimated by assuming
+  that the ones are evenly distributed.
+*/
+inline void
+prefetchSelect(const sdsl::sd_vector<>& v, size_type k)
+{
+  size_type ones = v.low.size();
+  if(k == 0 || k > ones) { return; }
+  prefetchElement(v.low, k - 1);
+  double buckets = static_cast<double>(v.size() >> v.wl);
+  size_type estimate = (k - 1) + static_cast<size_type>(buckets * (k - 1) / ones);
+  __builtin_prefetch(v.high.data() + (estimate >> 6));
+}
+
+/*
+  Prefetch the words of an sd_vector that rank(i) reads, using the same estimate for
+  the rank. Also prefetch the word of 'values' at the estimated rank.
+*/
+inline void
+prefetchRank(const sdsl::sd_vector<>& v, size_type i, const sdsl::int_vector<0>& values)
+{
+  size_type ones = v.low.size();
+  if(ones == 0 || v.size() == 0) { return; }
+  size_type rank = static_cast<size_type>(static_cast<double>(i) * ones / v.size());
+  prefetchElement(v.low, rank);
+  __builtin_prefetch(v.high.data() + (((i >> v.wl) + rank) >> 6));
+  prefetchElement(values, rank);
+}
+
+inline void
+prefetchIndex(const GBWT& gbwt, const LocateState& state)
+{
+  if(gbwt.bwt.hasDirectory()) { prefetchElement(gbwt.bwt.directory, state.comp); }
+  else
+  {
+    prefetchSelect(gbwt.bwt.index, state.comp + 1);
+    prefetchSelect(gbwt.bwt.index, state.comp + 2);
+  }
+
+  const DASamples& samples = gbwt.da_samples;
+  if(samples.hasFused()) { prefetchElement(samples.fused_index, state.comp); }
+  else { __builtin_prefetch(samples.sampled_records.data() + (state.comp >> 6)); }
+}
+
+inline void
+prefetchData(const GBWT& gbwt, LocateState& state)
+{
+  state.start = gbwt.bwt.start(state.comp); state.limit = gbwt.bwt.limit(state.comp);
+  __builtin_prefetch(gbwt.bwt.data.data() + state.start);
+  if(state.limit - state.start > 64) { __builtin_prefetch(gbwt.bwt.data.data() + state.start + 64); }
+
+  const DASamples& samples = gbwt.da_samples;
+  state.sample_rank = 0;
+  if(samples.hasFused())
+  {
+    size_type low = samples.fused_index[state.comp], high = samples.fused_index[state.comp + 1];
+    if(low < high) { prefetchElement(samples.fused_samples, low + high); } // First probe at 2 * mid.
+  }
+  else if(samples.sampled_records[state.comp])
+  {
+    // The rank structure of sampled_records is small and usually cached.
+    state.sample_rank = samples.record_rank(state.comp) + 1;
+    prefetchSelect(samples.bwt_ranges, state.sample_rank);
+  }
+}
+
+inline void
+prefetchSamples(const GBWT& gbwt, const LocateState& state)
+{
+  if(state.sample_rank == 0) { return; }
+  const DASamples& samples = gbwt.da_samples;
+  size_type record_start = samples.bwt_select(state.sample_rank);
+  prefetchRank(samples.sampled_offsets, record_start + state.offset, samples.array);
+}
+
+std::vector<size_type>
+GBWT::locate(const std::vector<edge_type>& positions) const
+{
+  std::vector<size_type> result(positions.size(), invalid_sequence());
+  // Queries in the index / data / sample stage; after the step.
+  std::vector<LocateState> indexed, fetched, ready, stepped;
+  indexed.reserve(LOCATE_WINDOW); fetched.reserve(LOCATE_WINDOW);
+  ready.reserve(LOCATE_WINDOW); stepped.reserve(LOCATE_WINDOW);
+  size_type next_query = 0;
+
+  while(next_query < positions.size() || !(indexed.empty()) || !(fetched.empty()) || !(ready.empty()))
+  {
+    // Fill the window with new queries.
+    while(indexed.size() + fetched.size() + ready.size() < LOCATE_WINDOW && next_query < positions.size())
+    {
+      edge_type position = positions[next_query];
+      if(this->contains(position.first))
+      {
+        LocateState state { next_query, this->toComp(position.first), position.second, 0, 0, 0 };
+        prefetchIndex(*this, state);
+        indexed.push_back(state);
+      }
+      next_query++;
+    }
+
+    // Advance the queries in the sample stage by one step. The queries that continue
+    // move to the index stage.
+    stepped.clear();
+    for(LocateState& state : ready)
+    {
+      size_type sample = this->da_samples.tryLocate(state.comp, state.offset);
+      if(sample != invalid_sequence()) { result[state.query] = sample; continue; }
+      CompressedRecord record(this->bwt.data, state.start, state.limit);
+      edge_type next = record.LF(state.offset);
+      if(next == invalid_edge()) { continue; }
+      state.comp = this->toComp(next.first); state.offset = next.second;
+      prefetchIndex(*this, state);
+      stepped.push_back(state);
+    }
+
+    // The queries in the data stage move to the sample stage, and the queries in
+    // the index stage move to the data stage.
+    for(LocateState& state : fetched) { prefetchSamples(*this, state); }
+    for(LocateState& state : indexed) { prefetchData(*this, state); }
+    ready.swap(fetched);
+    fetched.swap(indexed);
+    indexed.swap(stepped);
+  }
+
+  return result;
+}
+
+edge_type
+GBWT::inverseLF(node_type to, size_type i) const
+{
+  if(!(this->hasIncoming()) || to == ENDMARKER) { return invalid_edge(); }
+
+  edge_type inedge = this->incoming.predecessor(this->toComp(to), i);
+  if(inedge == invalid_edge()) { return invalid_edge(); }
+
+  size_type offset = this->record(inedge.first).select(i - inedge.second, to);
+  if(offset == invalid_offset()) { return invalid_edge(); }
+  return edge_type(inedge.first, offset);
+}
+
+std::vector<node_type>
+GBWT::extract(size_type sequence) const
+{
+  std::vector<node_type> result;
+  edge_type position = this->endmarker.LF(sequence);
+  while(position.first != ENDMARKER)
+  {
+    result.push_back(position.first);
+    position = this->LF(position);
+  }
+  return result;
+}
+
 //------------------------------------------------------------------------------
 
 CompressedRecord
@@ -170,6 +814,18 @@ printStatistics(const GBWT& gbwt, const std::string& name)
   printHeader("Samples"); std::cout << gbwt.samples() << std::endl;
   printHeader("BWT"); std::cout << inMegabytes(sdsl::size_in_bytes(gbwt.bwt)) << " MB" << std::endl;
   printHeader("Samples"); std::cout << inMegabytes(sdsl::size_in_bytes(gbwt.da_samples)) << " MB" << std::endl;
+  if(gbwt.hasIncoming())
+  {
+    printHeader("Incoming"); std::cout << inMegabytes(sdsl::size_in_bytes(gbwt.incoming)) << " MB" << std::endl;
+  }
+  if(gbwt.bwt.hasDirectory())
+  {
+    printHeader("Directory"); std::cout << inMegabytes(gbwt.bwt.directoryBytes()) << " MB (in memory)" << std::endl;
+  }
+  if(gbwt.da_samples.hasFused())
+  {
+    printHeader("Fused samples"); std::cout << inMegabytes(gbwt.da_samples.fusedBytes()) << " MB (in memory)" << std::endl;
+  }
   printHeader("Total"); std::cout << inMegabytes(sdsl::size_in_bytes(gbwt)) << " MB" << std::endl;
   std::cout << std::endl;
 }
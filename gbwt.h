@@ -43,6 +43,8 @@ public:
   typedef CompressedRecord::size_type size_type;
   typedef node_type                   comp_type; // Index of a record in this->bwt.
 
+  const static size_type LOCATE_WINDOW = 32; // Active queries in batch locate().
+
 //------------------------------------------------------------------------------
 
   GBWT();
@@ -54,6 +56,27 @@ public:
   GBWT& operator=(const GBWT& source);
   GBWT& operator=(GBWT&& source);
 
+  /*
+    Merges two compressed GBWTs without a dynamic intermediate. The sequences of the
+    second GBWT get identifiers after those of the first, and the header flags are taken
+    from the first GBWT. The result is the same as with DynamicGBWT::merge().
+  */
+  GBWT(const GBWT& first, const GBWT& second);
+
+  /*
+    Merges any number of compressed GBWTs. The sequence identifiers are assigned in the
+    order of the sources. The sources are merged pairwise in a balanced merge tree, so
+    each sequence is processed O(log k) times with k sources.
+  */
+  explicit GBWT(const std::vector<const GBWT*>& sources);
+
+  /*
+    As above, but loads the sources from the files. Each input is loaded when the merge
+    tree needs it and released after its pairwise merge. At most two inputs and the
+    intermediate results on the current path of the tree are in memory at once.
+  */
+  explicit GBWT(const std::vector<std::string>& filenames);
+
   size_type serialize(std::ostream& out, sdsl::structure_tree_node* v = nullptr, std::string name = "") const;
   void load(std::istream& in);
 
@@ -74,9 +97,11 @@ public:
   }
 
   inline comp_type toComp(node_type node) const { return (node == 0 ? node : node - this->header.offset); }
+  inline node_type toNode(comp_type comp) const { return (comp == 0 ? comp : comp + this->header.offset); }
 
   size_type runs() const;
   inline size_type samples() const { return this->da_samples.size(); }
+  inline bool hasIncoming() const { return (this->header.flags & GBWTHeader::FLAG_INCOMING); }
 
 //------------------------------------------------------------------------------
 
@@ -88,13 +113,14 @@ public:
   // On error: invalid_edge().
   inline edge_type LF(node_type from, size_type i) const
   {
+    if(from == ENDMARKER) { return this->endmarker.LF(i); }
     return this->record(from).LF(i);
   }
 
   // On error: invalid_edge().
   inline edge_type LF(edge_type position) const
   {
-    return this->record(position.first).LF(position.second);
+    return this->LF(position.first, position.second);
   }
 
   // On error: invalid_offset().
@@ -131,6 +157,27 @@ public:
   size_type locate(node_type node, size_type i) const;
   inline size_type locate(edge_type position) const { return this->locate(position.first, position.second); }
 
+  /*
+    Locate a batch of positions. The queries are advanced in round-robin order within
+    a window of LOCATE_WINDOW active queries. After each LF() step, the record index
+    and the sample structures are prefetched in three stages, and the memory latency is
+    hidden behind the steps of the other queries. This helps when consecutive records of
+    a path are far apart in memory. Returns invalid_sequence() for invalid positions.
+  */
+  std::vector<size_type> locate(const std::vector<edge_type>& positions) const;
+
+  /*
+    Inverse LF: returns (from, j) such that LF(from, j) == (to, i). Requires the
+    incoming edges. The endmarker does not have incoming edges.
+  */
+
+  // On error: invalid_edge().
+  edge_type inverseLF(node_type to, size_type i) const;
+  inline edge_type inverseLF(edge_type position) const { return this->inverseLF(position.first, position.second); }
+
+  // Returns the sequence without the endmarker or an empty sequence if there is no such sequence.
+  std::vector<node_type> extract(size_type sequence) const;
+
 //------------------------------------------------------------------------------
 
   // This returns the compressed record for the given node, assuming that it exists.
@@ -138,9 +185,13 @@ public:
 
 //------------------------------------------------------------------------------
 
-  GBWTHeader  header;
-  RecordArray bwt;
-  DASamples   da_samples;
+  GBWTHeader    header;
+  RecordArray   bwt;
+  DASamples     da_samples;
+  IncomingEdges incoming; // Only if header.flags contains FLAG_INCOMING.
+
+  // Built from the endmarker record. Not serialized.
+  EndmarkerIndex endmarker;
 
 //------------------------------------------------------------------------------
 
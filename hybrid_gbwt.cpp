@@ -0,0 +1,248 @@
+/*
+  Copyright (c) 2017 Genome Research Ltd.
+
+  Author: Jouni Siren <jouni.siren@iki.fi>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+
+#include "hybrid_gbwt.h"
+
+namespace gbwt
+{
+
+//------------------------------------------------------------------------------
+
+const std::string HybridGBWT::EXTENSION = ".gbwt";
+
+HybridGBWT::HybridGBWT(size_type budget) :
+  budget_bytes(budget)
+{
+}
+
+HybridGBWT::HybridGBWT(const HybridGBWT& source)
+{
+  this->copy(source);
+}
+
+HybridGBWT::HybridGBWT(HybridGBWT&& source)
+{
+  *this = std::move(source);
+}
+
+HybridGBWT::~HybridGBWT()
+{
+}
+
+void
+HybridGBWT::swap(HybridGBWT& another)
+{
+  if(this != &another)
+  {
+    this->index.swap(another.index);
+    std::swap(this->budget_bytes, another.budget_bytes);
+    this->decoded.swap(another.decoded);
+    this->decoded_records.swap(another.decoded_records);
+    sdsl::util::swap_support(this->decoded_rank, another.decoded_rank, &(this->decoded_records), &(another.decoded_records));
+  }
+}
+
+HybridGBWT&
+HybridGBWT::operator=(const HybridGBWT& source)
+{
+  if(this != &source) { this->copy(source); }
+  return *this;
+}
+
+HybridGBWT&
+HybridGBWT::operator=(HybridGBWT&& source)
+{
+  if(this != &source)
+  {
+    this->index = std::move(source.index);
+    this->budget_bytes = source.budget_bytes;
+    this->decoded = std::move(source.decoded);
+    this->decoded_records = std::move(source.decoded_records);
+    this->decoded_rank = std::move(source.decoded_rank);
+    this->decoded_rank.set_vector(&(this->decoded_records));
+  }
+  return *this;
+}
+
+size_type
+HybridGBWT::serialize(std::ostream& out, sdsl::structure_tree_node* v, std::string name) const
+{
+  return this->index.serialize(out, v, name);
+}
+
+void
+HybridGBWT::load(std::istream& in)
+{
+  this->index.load(in);
+  this->decodeBySize(this->budget());
+}
+
+void
+HybridGBWT::copy(const HybridGBWT& source)
+{
+  this->index = source.index;
+  this->budget_bytes = source.budget_bytes;
+  this->decoded = source.decoded;
+  this->decoded_records = source.decoded_records;
+  this->decoded_rank = source.decoded_rank;
+  this->decoded_rank.set_vector(&(this->decoded_records));
+}
+
+//------------------------------------------------------------------------------
+
+void
+HybridGBWT::decodeBySize(size_type budget)
+{
+  std::vector<size_type> decoded_bytes = this->decodedSizes();
+  std::vector<comp_type> order(this->effective());
+  for(comp_type comp = 0; comp < this->effective(); comp++) { order[comp] = comp; }
+
+  // Larger compressed records are slower to decode.
+  std::vector<size_type> compressed_bytes(this->effective());
+  for(comp_type comp = 0; comp < this->effective(); comp++)
+  {
+    compressed_bytes[comp] = this->index.bwt.limit(comp) - this->index.bwt.start(comp);
+  }
+  std::stable_sort(order.begin(), order.end(), [&compressed_bytes](comp_type a, comp_type b)
+  {
+    return (compressed_bytes[a] > compressed_bytes[b]);
+  });
+
+  this->decode(budget, order, decoded_bytes);
+}
+
+void
+HybridGBWT::decodeByProfile(size_type budget, const std::vector<size_type>& profile)
+{
+  std::vector<size_type> decoded_bytes = this->decodedSizes();
+  std::vector<comp_type> order;
+  for(comp_type comp = 0; comp < this->effective(); comp++)
+  {
+    node_type node = this->toNode(comp);
+    if(node < profile.size() && profile[node] > 0) { order.push_back(comp); }
+  }
+
+  // Compare accesses per byte without division: a / x > b / y iff a * y > b * x.
+  std::stable_sort(order.begin(), order.end(), [&](comp_type a, comp_type b)
+  {
+    double a_score = profile[this->toNode(a)] * static_cast<double>(decoded_bytes[b]);
+    double b_score = profile[this->toNode(b)] * static_cast<double>(decoded_bytes[a]);
+    return (a_score > b_score);
+  });
+
+  this->decode(budget, order, decoded_bytes);
+}
+
+size_type
+HybridGBWT::decodedBytes() const
+{
+  size_type result = 0;
+  for(const DecodedRecord& record : this->decoded) { result += record.bytes(); }
+  return result;
+}
+
+void
+HybridGBWT::decode(size_type budget, const std::vector<comp_type>& order, const std::vector<size_type>& decoded_bytes)
+{
+  double start = readTimer();
+  this->budget_bytes = budget;
+
+  // Select the records.
+  this->decoded_records = sdsl::bit_vector(this->effective(), 0);
+  size_type used_bytes = 0;
+  for(comp_type comp : order)
+  {
+    if(used_bytes + decoded_bytes[comp] <= budget)
+    {
+      this->decoded_records[comp] = 1;
+      used_bytes += decoded_bytes[comp];
+    }
+  }
+  sdsl::util::init_support(this->decoded_rank, &(this->decoded_records));
+
+  // Decode the selected records.
+  std::vector<comp_type> selected;
+  for(comp_type comp = 0; comp < this->effective(); comp++)
+  {
+    if(this->decoded_records[comp]) { selected.push_back(comp); }
+  }
+  this->decoded = std::vector<DecodedRecord>(selected.size());
+  #pragma omp parallel for schedule(dynamic, 1)
+  for(size_type i = 0; i < selected.size(); i++)
+  {
+    this->decoded[i] = DecodedRecord(this->index.record(this->toNode(selected[i])));
+  }
+
+  if(Verbosity::level >= Verbosity::EXTENDED)
+  {
+    double seconds = readTimer() - start;
+    std::cerr << "HybridGBWT::decode(): Decoded " << selected.size() << " records ("
+              << inMegabytes(used_bytes) << " MB) in " << seconds << " seconds" << std::endl;
+  }
+}
+
+std::vector<size_type>
+HybridGBWT::decodedSizes() const
+{
+  std::vector<size_type> result(this->effective());
+  #pragma omp parallel for schedule(dynamic, 1024)
+  for(comp_type comp = 0; comp < this->effective(); comp++)
+  {
+    CompressedRecord record = this->index.record(this->toNode(comp));
+    result[comp] = DecodedRecord::bytes(record.outdegree(), record.runs());
+  }
+  return result;
+}
+
+//------------------------------------------------------------------------------
+
+size_type
+HybridGBWT::locate(node_type node, size_type i) const
+{
+  if(!(this->contains(node))) { return invalid_sequence(); }
+
+  while(true)
+  {
+    size_type result = this->tryLocate(node, i);
+    if(result != invalid_sequence()) { return result; }
+    std::tie(node, i) = this->LF(node, i);
+  }
+}
+
+//------------------------------------------------------------------------------
+
+void
+printStatistics(const HybridGBWT& gbwt, const std::string& name)
+{
+  printStatistics(gbwt.index, name);
+  printHeader("Decoded records"); std::cout << gbwt.decodedRecords() << std::endl;
+  printHeader("Decoded size"); std::cout << inMegabytes(gbwt.decodedBytes()) << " MB" << std::endl;
+  printHeader("Budget"); std::cout << inMegabytes(gbwt.budget()) << " MB" << std::endl;
+  std::cout << std::endl;
+}
+
+//------------------------------------------------------------------------------
+
+} // namespace gbwt
@@ -0,0 +1,184 @@
+/*
+  Copyright (c) 2017 Genome Research Ltd.
+
+  Author: Jouni Siren <jouni.siren@iki.fi>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+
+#ifndef GBWT_HYBRID_GBWT_H
+#define GBWT_HYBRID_GBWT_H
+
+#include "gbwt.h"
+
+namespace gbwt
+{
+
+/*
+  hybrid_gbwt.h: Compressed GBWT with some of the records decoded.
+*/
+
+//------------------------------------------------------------------------------
+
+/*
+  A compressed GBWT that keeps the records selected at load time as DecodedRecords.
+  The memory budget for the decoded records is a construction parameter. The records
+  are selected greedily by the size of the compressed record or by an access profile,
+  skipping the records that do not fit in the remaining budget. The compressed
+  versions of the decoded records are kept, as they are needed for serialization.
+
+  The file format is the same as for GBWT.
+*/
+
+class HybridGBWT
+{
+public:
+  typedef GBWT::size_type size_type;
+  typedef GBWT::comp_type comp_type;
+
+  const static size_type DEFAULT_BUDGET = GIGABYTE;
+
+//------------------------------------------------------------------------------
+
+  explicit HybridGBWT(size_type budget = DEFAULT_BUDGET);
+  HybridGBWT(const HybridGBWT& source);
+  HybridGBWT(HybridGBWT&& source);
+  ~HybridGBWT();
+
+  void swap(HybridGBWT& another);
+  HybridGBWT& operator=(const HybridGBWT& source);
+  HybridGBWT& operator=(HybridGBWT&& source);
+
+  size_type serialize(std::ostream& out, sdsl::structure_tree_node* v = nullptr, std::string name = "") const;
+  void load(std::istream& in); // Selects the records by size.
+
+  const static std::string EXTENSION; // .gbwt
+
+//------------------------------------------------------------------------------
+
+  // Replace the decoded records with the largest compressed records that fit in the budget.
+  void decodeBySize(size_type budget);
+
+  /*
+    Replace the decoded records with a new selection. The profile contains the number
+    of accesses to each node, and the records with the most accesses per decoded byte
+    are selected first. Nodes missing from the profile have no accesses.
+  */
+  void decodeByProfile(size_type budget, const std::vector<size_type>& profile);
+
+  inline size_type budget() const { return this->budget_bytes; }
+  inline size_type decodedRecords() const { return this->decoded.size(); }
+  size_type decodedBytes() const;
+
+  inline bool isDecoded(node_type node) const { return this->decoded_records[this->toComp(node)]; }
+
+//------------------------------------------------------------------------------
+
+  inline size_type size() const { return this->index.size(); }
+  inline bool empty() const { return this->index.empty(); }
+  inline size_type sequences() const { return this->index.sequences(); }
+  inline size_type sigma() const { return this->index.sigma(); }
+  inline size_type effective() const { return this->index.effective(); }
+  inline bool contains(node_type node) const { return this->index.contains(node); }
+  inline comp_type toComp(node_type node) const { return this->index.toComp(node); }
+  inline node_type toNode(comp_type comp) const { return this->index.toNode(comp); }
+
+  inline size_type runs() const { return this->index.runs(); }
+  inline size_type samples() const { return this->index.samples(); }
+
+//------------------------------------------------------------------------------
+
+  /*
+    The interface assumes that the node identifiers are valid. They can be checked with
+    contains().
+  */
+
+  // On error: invalid_edge().
+  inline edge_type LF(node_type from, size_type i) const
+  {
+    comp_type comp = this->toComp(from);
+    if(this->decoded_records[comp]) { return this->decodedRecord(comp).LF(i); }
+    return this->index.LF(from, i);
+  }
+
+  // On error: invalid_edge().
+  inline edge_type LF(edge_type position) const { return this->LF(position.first, position.second); }
+
+  // On error: invalid_offset().
+  inline size_type LF(node_type from, size_type i, node_type to) const
+  {
+    comp_type comp = this->toComp(from);
+    if(this->decoded_records[comp]) { return this->decodedRecord(comp).LF(i, to); }
+    return this->index.LF(from, i, to);
+  }
+
+  // On error: invalid_offset().
+  inline size_type LF(edge_type position, node_type to) const { return this->LF(position.first, position.second, to); }
+
+  // On error: Range::empty_range().
+  inline range_type LF(node_type from, range_type range, node_type to) const
+  {
+    comp_type comp = this->toComp(from);
+    if(this->decoded_records[comp]) { return this->decodedRecord(comp).LF(range, to); }
+    return this->index.LF(from, range, to);
+  }
+
+  // Returns the sampled document identifier or invalid_sequence() if there is no sample.
+  inline size_type tryLocate(node_type node, size_type i) const { return this->index.tryLocate(node, i); }
+  inline size_type tryLocate(edge_type position) const { return this->index.tryLocate(position); }
+
+  // On error: invalid_sequence().
+  size_type locate(node_type node, size_type i) const;
+  inline size_type locate(edge_type position) const { return this->locate(position.first, position.second); }
+
+//------------------------------------------------------------------------------
+
+  GBWT                          index;
+
+  size_type                     budget_bytes;
+
+  // Decoded records in the order of the record identifiers.
+  std::vector<DecodedRecord>    decoded;
+  sdsl::bit_vector              decoded_records;
+  sdsl::bit_vector::rank_1_type decoded_rank;
+
+//------------------------------------------------------------------------------
+
+private:
+  void copy(const HybridGBWT& source);
+
+  inline const DecodedRecord& decodedRecord(comp_type comp) const
+  {
+    return this->decoded[this->decoded_rank(comp)];
+  }
+
+  // Decode the records in the given order until the budget is exhausted.
+  void decode(size_type budget, const std::vector<comp_type>& order, const std::vector<size_type>& decoded_bytes);
+
+  std::vector<size_type> decodedSizes() const;
+};
+
+void printStatistics(const HybridGBWT& gbwt, const std::string& name);
+
+//------------------------------------------------------------------------------
+
+} // namespace gbwt
+
+#endif // GBWT_HYBRID_GBWT_H
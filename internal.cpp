@@ -54,21 +54,4 @@ RunMerger::flush()
 
 //------------------------------------------------------------------------------
 
-Sequence::Sequence() :
-  id(0), curr(ENDMARKER), next(ENDMARKER), offset(0), pos(0)
-{
-}
-
-Sequence::Sequence(const text_type& text, size_type i, size_type seq_id) :
-  id(seq_id), curr(ENDMARKER), next(text[i]), offset(seq_id), pos(i)
-{
-}
-
-Sequence::Sequence(node_type node, size_type seq_id, size_type source_pos) :
-  id(seq_id), curr(ENDMARKER), next(node), offset(seq_id), pos(source_pos)
-{
-}
-
-//------------------------------------------------------------------------------
-
 } // namespace gbwt
@@ -27,6 +27,8 @@
 
 #include "support.h"
 
+#include <limits>
+
 namespace gbwt
 {
 
@@ -154,6 +156,37 @@ struct Run
   }
 };
 
+/*
+  Run decoder for a small fixed alphabet size. The division and the modulo by a
+  compile-time constant become multiplications and shifts, and the branch for the
+  encoding used with large alphabets disappears. Interchangeable with Run as the
+  decoder of the record iterators.
+*/
+
+template<size_type SIGMA>
+struct FixedRun
+{
+  typedef Run::code_type code_type;
+
+  static_assert(SIGMA > 0 && SIGMA < std::numeric_limits<code_type>::max(), "FixedRun: Invalid alphabet size");
+
+  const static size_type RUN_CONTINUES = (static_cast<size_type>(std::numeric_limits<code_type>::max()) + 1) / SIGMA;
+
+  explicit FixedRun(size_type) {}
+
+  /*
+    Returns (value, run length) and updates i to point past the run.
+  */
+  template<class ByteArray>
+  run_type read(ByteArray& array, size_type& i)
+  {
+    code_type code = array[i]; i++;
+    run_type run(code % SIGMA, code / SIGMA + 1);
+    if(run.second >= RUN_CONTINUES) { run.second += ByteCode::read(array, i); }
+    return run;
+  }
+};
+
 //------------------------------------------------------------------------------
 
 /*
@@ -164,7 +197,7 @@ struct RunMerger
 {
   size_type              total_size;
   run_type               accumulator;
-  std::vector<run_type>  runs;
+  PairVector             runs;
   std::vector<size_type> counts;
 
   RunMerger(size_type sigma) : total_size(0), accumulator(0, 0), counts(sigma) {}
@@ -189,25 +222,41 @@ struct RunMerger
 
 /*
   A text iterator corresponding to a sequence. Used for GBWT construction.
+
+  PackedSequence uses 32-bit fields, which halves the memory usage and the memory
+  traffic in sorting. It can be used when node identifiers, sequence identifiers,
+  record offsets, and text positions / source offsets are all below fitsPacked().
 */
 
-struct Sequence
+template<class IntegerType>
+struct BasicSequence
 {
-  size_type id;
-  node_type curr, next;
-  size_type offset; // Offset in the current record.
-  size_type pos;    // Position in the text or offset in the source record.
+  typedef IntegerType integer_type;
+
+  integer_type id;
+  integer_type curr, next;
+  integer_type offset; // Offset in the current record.
+  integer_type pos;    // Position in the text or offset in the source record.
 
-  Sequence();
+  BasicSequence() :
+    id(0), curr(ENDMARKER), next(ENDMARKER), offset(0), pos(0)
+  {
+  }
 
   // Create a sequence starting from text[i].
-  Sequence(const text_type& text, size_type i, size_type seq_id);
+  BasicSequence(const text_type& text, size_type i, size_type seq_id) :
+    id(seq_id), curr(ENDMARKER), next(text[i]), offset(seq_id), pos(i)
+  {
+  }
 
-  // Create a sequence where endmarker[source_pos] == node.
-  Sequence(node_type node, size_type seq_id, size_type source_pos);
+  // Create a sequence starting from offset source_pos in the source record of the node.
+  BasicSequence(node_type node, size_type seq_id, size_type source_pos) :
+    id(seq_id), curr(ENDMARKER), next(node), offset(seq_id), pos(source_pos)
+  {
+  }
 
   // Sort by reverse prefixes text[..pos+1].
-  inline bool operator<(const Sequence& another) const
+  inline bool operator<(const BasicSequence& another) const
   {
     if(this->next != another.next) { return (this->next < another.next); }
     if(this->curr != another.curr) { return (this->curr < another.curr); }
@@ -215,61 +264,99 @@ struct Sequence
   }
 };
 
+typedef BasicSequence<size_type>     Sequence;
+typedef BasicSequence<std::uint32_t> PackedSequence;
+
+// Returns true if PackedSequence can store all values < limit.
+inline bool fitsPacked(size_type limit)
+{
+  return (limit <= static_cast<size_type>(std::numeric_limits<std::uint32_t>::max()) + 1);
+}
+
 //------------------------------------------------------------------------------
 
 /*
-  Iterators for CompressedRecords.
-
-  - CompressedRecordIterator is the fastest, as it only iterates over the runs.
-  - CompressedRecordRankIterator keeps track of the rank for one successor node.
-  - CompressedRecordFullIterator is the slowest, as it keeps track of the ranks
-    for all successor nodes.
+  Rank policies for the CompressedRecord iterator. The iterator calls add(run) for
+  each decoded run and reset(record) when it restarts from the beginning.
 
-  FIXME a single iterator with a RankCalculator as a template parameter.
+  - NoRanks does not track anything.
+  - OutrankRank tracks LF(offset(), successor(outrank)) for a single outrank.
+  - AllRanks tracks LF(offset(), successor(outrank)) for all outranks. The ranks are
+    stored in a fixed-size array, unless the outdegree exceeds SMALL_OUTDEGREE.
 */
 
-struct CompressedRecordIterator
+struct NoRanks
 {
-  explicit CompressedRecordIterator(const CompressedRecord& source) :
-    record(source), decoder(source.outdegree()),
-    record_offset(0), curr_offset(0), next_offset(0)
+  explicit NoRanks(const CompressedRecord&) {}
+
+  inline void add(run_type) {}
+  inline void reset(const CompressedRecord&) {}
+};
+
+struct OutrankRank
+{
+  OutrankRank(const CompressedRecord& record, rank_type outrank) :
+    value(outrank), result(record.offset(outrank))
   {
-    this->read();
   }
 
-  inline bool end() const { return (this->curr_offset >= this->record.data_size); }
-  inline void operator++() { this->curr_offset = this->next_offset; this->read(); }
+  inline void add(run_type run) { if(run.first == this->value) { this->result += run.second; } }
+  inline void reset(const CompressedRecord& record) { this->result = record.offset(this->value); }
 
-  inline run_type operator*() const { return this->run; }
-  inline const run_type* operator->() { return &(this->run); }
+  rank_type value;
+  size_type result;
+};
 
-  // After the current run.
-  inline size_type offset() const { return this->record_offset; }
+struct AllRanks
+{
+  explicit AllRanks(const CompressedRecord& record)
+  {
+    if(record.outdegree() <= SMALL_OUTDEGREE) { this->ranks = this->stack_ranks; }
+    else { this->heap_ranks.resize(record.outdegree()); this->ranks = this->heap_ranks.data(); }
+    this->reset(record);
+  }
 
-  const CompressedRecord& record;
-  Run                     decoder;
+  AllRanks(const AllRanks&) = delete;
+  AllRanks& operator=(const AllRanks&) = delete;
 
-  size_type               record_offset;
-  size_type               curr_offset, next_offset;
-  run_type                run;
+  inline void add(run_type run) { this->ranks[run.first] += run.second; }
+  inline size_type rank(rank_type outrank) const { return this->ranks[outrank]; }
 
-private:
-  inline void read()
+  inline void reset(const CompressedRecord& record)
   {
-    if(!(this->end()))
-    {
-      this->run = this->decoder.read(this->record.body, this->next_offset);
-      this->record_offset += this->run.second;
-    }
+    for(rank_type outrank = 0; outrank < record.outdegree(); outrank++) { this->ranks[outrank] = record.offset(outrank); }
   }
+
+  size_type*             ranks;
+  size_type              stack_ranks[SMALL_OUTDEGREE];
+  std::vector<size_type> heap_ranks;
 };
 
-struct CompressedRecordRankIterator
+/*
+  An iterator over the runs of a CompressedRecord, templated on the run decoder (Run or
+  FixedRun) and the rank policy. The rank queries are only available with the rank
+  policies that support them. The record must have outgoing edges.
+
+  - CompressedRecordIterator only iterates over the runs.
+  - CompressedRecordRankIterator keeps track of the rank for one successor node.
+  - CompressedRecordFullIterator keeps track of the ranks for all successor nodes.
+  - CompressedRecordCursor is a full iterator that owns a copy of the record and
+    can seek to any offset.
+*/
+
+template<class Decoder, class RankPolicy>
+struct BasicCompressedRecordIterator
 {
-  explicit CompressedRecordRankIterator(const CompressedRecord& source, rank_type outrank) :
-    record(source), decoder(source.outdegree()),
-    record_offset(0), curr_offset(0), next_offset(0),
-    value(outrank), result(source.offset(outrank))
+  explicit BasicCompressedRecordIterator(const CompressedRecord& source) :
+    record(source), decoder(source.outdegree()), ranks(source),
+    record_offset(0), curr_offset(0), next_offset(0)
+  {
+    this->read();
+  }
+
+  BasicCompressedRecordIterator(const CompressedRecord& source, rank_type outrank) :
+    record(source), decoder(source.outdegree()), ranks(source, outrank),
+    record_offset(0), curr_offset(0), next_offset(0)
   {
     this->read();
   }
@@ -277,31 +364,44 @@ struct CompressedRecordRankIterator
   inline bool end() const { return (this->curr_offset >= this->record.data_size); }
   inline void operator++() { this->curr_offset = this->next_offset; this->read(); }
 
+  // Returns to the first run.
+  inline void restart()
+  {
+    this->ranks.reset(this->record);
+    this->record_offset = 0; this->curr_offset = 0; this->next_offset = 0;
+    this->read();
+  }
+
   inline run_type operator*() const { return this->run; }
-  inline const run_type* operator->() { return &(this->run); }
+  inline const run_type* operator->() const { return &(this->run); }
 
   // After the current run.
   inline size_type offset() const { return this->record_offset; }
-  inline size_type rank() const { return this->result; }
 
-  // Intended for positions i covered by the current run.
+  // With OutrankRank. Intended for positions i covered by the current run.
   inline size_type rankAt(size_type i) const
   {
-    size_type temp = this->rank();
-    if(i < this->offset() && this->run.first == value) { temp -= (this->offset() - i); }
+    size_type temp = this->ranks.result;
+    if(i < this->offset() && this->run.first == this->ranks.value) { temp -= (this->offset() - i); }
     return temp;
   }
 
+  // With AllRanks.
+  inline size_type rank(rank_type outrank) const { return this->ranks.rank(outrank); }
+  inline edge_type edge() const { return this->edge(this->run.first); }
+  inline edge_type edge(rank_type outrank) const
+  {
+    return edge_type(this->record.successor(outrank), this->rank(outrank));
+  }
+
   const CompressedRecord& record;
-  Run                     decoder;
+  Decoder                 decoder;
+  RankPolicy              ranks;
 
   size_type               record_offset;
   size_type               curr_offset, next_offset;
   run_type                run;
 
-  rank_type               value;
-  size_type               result;
-
 private:
   inline void read()
   {
@@ -309,51 +409,48 @@ private:
     {
       this->run = this->decoder.read(this->record.body, this->next_offset);
       this->record_offset += this->run.second;
-      if(this->run.first == value) { this->result += this->run.second; }
+      this->ranks.add(this->run);
     }
   }
 };
 
-struct CompressedRecordFullIterator
+typedef BasicCompressedRecordIterator<Run, NoRanks>     CompressedRecordIterator;
+typedef BasicCompressedRecordIterator<Run, OutrankRank> CompressedRecordRankIterator;
+typedef BasicCompressedRecordIterator<Run, AllRanks>    CompressedRecordFullIterator;
+
+/*
+  Seeking to non-decreasing offsets continues from the current run, so a sequence of
+  seeks costs a single pass over the body. Seeking to an offset before the current
+  run restarts from the beginning of the record. The record must be declared before
+  the iterator that refers to it.
+*/
+
+struct CompressedRecordCursor
 {
-  explicit CompressedRecordFullIterator(const CompressedRecord& source) :
-    record(source), decoder(source.outdegree()), ranks(source.outgoing),
-    record_offset(0), curr_offset(0), next_offset(0)
+  explicit CompressedRecordCursor(const CompressedRecord& source) :
+    record(source), iter(this->record)
   {
-    this->read();
   }
 
-  inline bool end() const { return (this->curr_offset >= this->record.data_size); }
-  inline void operator++() { this->curr_offset = this->next_offset; this->read(); }
-
-  inline run_type operator*() const { return this->run; }
-  inline const run_type* operator->() { return &(this->run); }
-
-  // After the current run.
-  inline size_type offset() const { return this->record_offset; }
-  inline size_type rank() const { return this->rank(this->run.first); }
-  inline size_type rank(rank_type outrank) const { return this->ranks[outrank].second; }
-  inline edge_type edge() const { return this->edge(this->run.first); }
-  inline edge_type edge(rank_type outrank) const { return this->ranks[outrank]; }
-
-  const CompressedRecord& record;
-  Run                     decoder;
-  std::vector<edge_type>  ranks;
-
-  size_type               record_offset;
-  size_type               curr_offset, next_offset;
-  run_type                run;
+  // Moves to the run covering offset i, assuming that the offset is valid.
+  inline void seek(size_type i)
+  {
+    if(i < this->iter.offset() - this->iter->second) { this->iter.restart(); }
+    while(this->iter.offset() <= i && this->iter.next_offset < this->record.data_size) { ++(this->iter); }
+  }
 
-private:
-  inline void read()
+  // These are intended for the offset i of the last seek.
+  inline node_type successor() const { return this->record.successor(this->iter->first); }
+  inline size_type rankAt(size_type i) const
   {
-    if(!(this->end()))
-    {
-      this->run = this->decoder.read(this->record.body, this->next_offset);
-      this->record_offset += this->run.second;
-      this->ranks[this->run.first].second += this->run.second;
-    }
+    return this->iter.rank(this->iter->first) - (this->iter.offset() - i);
   }
+
+  CompressedRecord             record;
+  CompressedRecordFullIterator iter;
+
+  CompressedRecordCursor(const CompressedRecordCursor&) = delete;
+  CompressedRecordCursor& operator=(const CompressedRecordCursor&) = delete;
 };
 
 //------------------------------------------------------------------------------
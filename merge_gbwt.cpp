@@ -34,6 +34,8 @@ void printUsage(int exit_code = EXIT_SUCCESS);
 
 size_type insert(DynamicGBWT& index, const std::string input_name, size_type batch_size);
 
+size_type printInput(const std::string& filename, const std::string& name);
+
 //------------------------------------------------------------------------------
 
 int
@@ -42,13 +44,16 @@ main(int argc, char** argv)
   if(argc < 3) { printUsage(); }
 
   size_type batch_size = DynamicGBWT::MERGE_BATCH_SIZE;
+  bool compressed_merge = false;
   int c = 0;
-  while((c = getopt(argc, argv, "b:")) != -1)
+  while((c = getopt(argc, argv, "b:f")) != -1)
   {
     switch(c)
     {
     case 'b':
       batch_size = std::stoul(optarg); break;
+    case 'f':
+      compressed_merge = true; break;
     case '?':
       std::exit(EXIT_FAILURE);
     default:
@@ -63,24 +68,41 @@ main(int argc, char** argv)
   std::cout << std::endl;
 
   printHeader("Output"); std::cout << output << std::endl;
-  printHeader("Batch size"); std::cout << batch_size << std::endl;
+  if(compressed_merge) { printHeader("Algorithm"); std::cout << "compressed" << std::endl; }
+  else { printHeader("Batch size"); std::cout << batch_size << std::endl; }
   std::cout << std::endl;
 
   double start = readTimer();
 
-  DynamicGBWT index;
-  sdsl::load_from_file(index, first_input + DynamicGBWT::EXTENSION);
-  printStatistics(index, first_input);
-
   size_type total_inserted = 0;
-  while(optind + 1 < argc)
+  if(compressed_merge)
   {
-    std::string input_name = argv[optind]; optind++;
-    total_inserted += insert(index, input_name, batch_size);
+    std::vector<std::string> inputs;
+    inputs.push_back(first_input + GBWT::EXTENSION);
+    printInput(inputs.back(), first_input);
+    while(optind + 1 < argc)
+    {
+      std::string input_name = argv[optind]; optind++;
+      inputs.push_back(input_name + GBWT::EXTENSION);
+      total_inserted += printInput(inputs.back(), input_name);
+    }
+    GBWT index(inputs);
+    sdsl::store_to_file(index, output + GBWT::EXTENSION);
+    printStatistics(index, output);
+  }
+  else
+  {
+    DynamicGBWT index;
+    sdsl::load_from_file(index, first_input + DynamicGBWT::EXTENSION);
+    printStatistics(index, first_input);
+    while(optind + 1 < argc)
+    {
+      std::string input_name = argv[optind]; optind++;
+      total_inserted += insert(index, input_name, batch_size);
+    }
+    sdsl::store_to_file(index, output + DynamicGBWT::EXTENSION);
+    printStatistics(index, output);
   }
-
-  sdsl::store_to_file(index, output + DynamicGBWT::EXTENSION);
-  printStatistics(index, output);
 
   double seconds = readTimer() - start;
 
@@ -100,6 +122,7 @@ printUsage(int exit_code)
   std::cerr << "Usage: merge_gbwt [options] input1 [input2 ...] output" << std::endl;
   std::cerr << "  -b N  Use batches of N sequences for merging (default "
             << DynamicGBWT::MERGE_BATCH_SIZE << ")" << std::endl;
+  std::cerr << "  -f    Merge the compressed GBWTs directly without a dynamic GBWT" << std::endl;
   std::cerr << std::endl;
   std::cerr << "Use base names for the inputs and the output. Using compressed GBWTs from input2" << std::endl;
   std::cerr << "onwards saves memory but is slower." << std::endl;
@@ -118,4 +141,23 @@ insert(DynamicGBWT& index, const std::string input_name, size_type batch_size)
   return next.size();
 }
 
+// Prints the header of a compressed GBWT without loading the index and returns the total length.
+size_type
+printInput(const std::string& filename, const std::string& name)
+{
+  std::ifstream in(filename, std::ios_base::binary);
+  if(!in)
+  {
+    std::cerr << "merge_gbwt: Cannot open input " << filename << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+  GBWTHeader header;
+  header.load(in);
+  printHeader("Input"); std::cout << name << std::endl;
+  printHeader("Total length"); std::cout << header.size << std::endl;
+  printHeader("Sequences"); std::cout << header.sequences << std::endl;
+  std::cout << std::endl;
+  return header.size;
+}
+
 //------------------------------------------------------------------------------
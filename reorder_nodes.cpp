@@ -0,0 +1,302 @@
+/*
+  Copyright (c) 2017 Genome Research Ltd.
+
+  Author: Jouni Siren <jouni.siren@iki.fi>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+
+#include <unistd.h>
+
+#include "dynamic_gbwt.h"
+
+using namespace gbwt;
+
+//------------------------------------------------------------------------------
+
+const size_type DEFAULT_BENCHMARK_SEQUENCES = 1000;
+const std::string TRANSLATION_EXTENSION = ".translation";
+
+void printUsage(int exit_code = EXIT_SUCCESS);
+
+// Returns a translation table from old node ids to new node ids.
+sdsl::int_vector<0> firstOccurrenceOrder(text_buffer_type& text, node_type min_node, node_type max_node);
+sdsl::int_vector<0> bfsOrder(text_buffer_type& text, node_type min_node, node_type max_node);
+
+void benchmark(const GBWT& original, const GBWT& reordered, size_type sequences);
+
+//------------------------------------------------------------------------------
+
+int
+main(int argc, char** argv)
+{
+  if(argc < 3) { printUsage(); }
+
+  size_type batch_size = DynamicGBWT::INSERT_BATCH_SIZE / MILLION;
+  size_type benchmark_sequences = DEFAULT_BENCHMARK_SEQUENCES;
+  bool bfs = false;
+  int c = 0;
+  while((c = getopt(argc, argv, "b:Bq:")) != -1)
+  {
+    switch(c)
+    {
+    case 'b':
+      batch_size = std::stoul(optarg); break;
+    case 'B':
+      bfs = true; break;
+    case 'q':
+      benchmark_sequences = std::stoul(optarg); break;
+    case '?':
+      std::exit(EXIT_FAILURE);
+    default:
+      std::exit(EXIT_FAILURE);
+    }
+  }
+  if(optind + 1 >= argc) { printUsage(EXIT_FAILURE); }
+  std::string input_name = argv[optind], output_name = argv[optind + 1];
+
+  std::cout << "Node reordering" << std::endl;
+  std::cout << std::endl;
+
+  printHeader("Input"); std::cout << input_name << std::endl;
+  printHeader("Output"); std::cout << output_name << std::endl;
+  printHeader("Order"); std::cout << (bfs ? "breadth-first" : "first occurrence") << std::endl;
+  if(batch_size != 0) { printHeader("Batch size"); std::cout << batch_size << " million" << std::endl; }
+  std::cout << std::endl;
+
+  double start = readTimer();
+
+  // Determine the node range and the new order.
+  text_buffer_type input(input_name);
+  node_type min_node = ~(node_type)0, max_node = 0;
+  for(node_type node : input)
+  {
+    if(node == ENDMARKER) { continue; }
+    min_node = std::min(node, min_node); max_node = std::max(node, max_node);
+  }
+  if(max_node == 0)
+  {
+    std::cerr << "reorder_nodes: The input does not contain any nodes" << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+  sdsl::int_vector<0> translation =
+    (bfs ? bfsOrder(input, min_node, max_node) : firstOccurrenceOrder(input, min_node, max_node));
+  sdsl::store_to_file(translation, output_name + TRANSLATION_EXTENSION);
+
+  // Translate the text.
+  {
+    text_buffer_type output(output_name, std::ios::out, MEGABYTE, bit_length(max_node));
+    for(node_type node : input) { output.push_back(translation[node]); }
+    output.close();
+  }
+  double seconds = readTimer() - start;
+  std::cout << "Translated " << input.size() << " nodes in " << seconds << " seconds" << std::endl;
+  std::cout << std::endl;
+
+  // Build the GBWT for the reordered text.
+  {
+    Verbosity::set(Verbosity::SILENT);
+    DynamicGBWT gbwt;
+    text_buffer_type reordered(output_name);
+    gbwt.insert(reordered, batch_size * MILLION);
+    sdsl::store_to_file(gbwt, output_name + DynamicGBWT::EXTENSION);
+  }
+
+  // Compare the original and the reordered GBWT.
+  GBWT original, reordered;
+  if(!sdsl::load_from_file(original, input_name + GBWT::EXTENSION))
+  {
+    std::cerr << "reorder_nodes: Cannot load " << input_name << GBWT::EXTENSION << "; skipping the benchmark" << std::endl;
+    return 0;
+  }
+  sdsl::load_from_file(reordered, output_name + GBWT::EXTENSION);
+  printStatistics(original, input_name);
+  printStatistics(reordered, output_name);
+  benchmark(original, reordered, benchmark_sequences);
+
+  std::cout << "Memory usage " << inGigabytes(memoryUsage()) << " GB" << std::endl;
+  std::cout << std::endl;
+
+  return 0;
+}
+
+//------------------------------------------------------------------------------
+
+void
+printUsage(int exit_code)
+{
+  std::cerr << "Usage: reorder_nodes [options] input output" << std::endl;
+  std::cerr << "  -b N  Insert in batches of N million nodes (default "
+            << (DynamicGBWT::INSERT_BATCH_SIZE / MILLION) << ")" << std::endl;
+  std::cerr << "  -B    Use breadth-first order instead of the order of first occurrence" << std::endl;
+  std::cerr << "  -q N  Use N sequences in the benchmark (default " << DEFAULT_BENCHMARK_SEQUENCES << ")" << std::endl;
+  std::cerr << std::endl;
+  std::cerr << "Renumbers the nodes in the input text so that the records of nodes visited together" << std::endl;
+  std::cerr << "are close to each other. Writes the translated text to output, the translation" << std::endl;
+  std::cerr << "table (old id -> new id) to output" << TRANSLATION_EXTENSION << ", and the GBWT to output"
+            << GBWT::EXTENSION << "." << std::endl;
+  std::cerr << "If input" << GBWT::EXTENSION << " exists, compares the speed of the two GBWTs." << std::endl;
+  std::cerr << std::endl;
+
+  std::exit(exit_code);
+}
+
+//------------------------------------------------------------------------------
+
+/*
+  The new identifiers are assigned from 'min_node' onwards, so the alphabet offset does
+  not change. The endmarker and the unused identifiers are mapped to 0.
+*/
+
+sdsl::int_vector<0>
+firstOccurrenceOrder(text_buffer_type& text, node_type min_node, node_type max_node)
+{
+  sdsl::int_vector<0> translation(max_node + 1, 0, bit_length(max_node));
+  node_type next_id = min_node;
+  for(node_type node : text)
+  {
+    if(node != ENDMARKER && translation[node] == 0) { translation[node] = next_id; next_id++; }
+  }
+  return translation;
+}
+
+/*
+  Breadth-first order in the graph induced by the sequences, starting from the first node.
+  When the queue becomes empty, we continue from the next unvisited node in the order of
+  first occurrence.
+*/
+
+sdsl::int_vector<0>
+bfsOrder(text_buffer_type& text, node_type min_node, node_type max_node)
+{
+  // Build the adjacency lists.
+  std::vector<edge_type> edges;
+  std::vector<node_type> first_occurrences;
+  {
+    std::vector<bool> seen(max_node + 1, false);
+    for(size_type i = 0; i < text.size(); i++)
+    {
+      node_type node = text[i];
+      if(node == ENDMARKER) { continue; }
+      if(!seen[node]) { seen[node] = true; first_occurrences.push_back(node); }
+      if(i + 1 < text.size() && text[i + 1] != ENDMARKER) { edges.push_back(edge_type(node, text[i + 1])); }
+    }
+  }
+  removeDuplicates(edges, true);
+  std::vector<size_type> adjacency(max_node + 2, 0);
+  for(edge_type edge : edges) { adjacency[edge.first + 1]++; }
+  for(node_type node = 0; node <= max_node; node++) { adjacency[node + 1] += adjacency[node]; }
+
+  sdsl::int_vector<0> translation(max_node + 1, 0, bit_length(max_node));
+  node_type next_id = min_node;
+  std::vector<node_type> queue;
+  for(node_type root : first_occurrences)
+  {
+    if(translation[root] != 0) { continue; }
+    translation[root] = next_id; next_id++;
+    queue.clear(); queue.push_back(root);
+    for(size_type head = 0; head < queue.size(); head++)
+    {
+      node_type node = queue[head];
+      for(size_type i = adjacency[node]; i < adjacency[node + 1]; i++)
+      {
+        node_type successor = edges[i].second;
+        if(translation[successor] == 0)
+        {
+          translation[successor] = next_id; next_id++;
+          queue.push_back(successor);
+        }
+      }
+    }
+  }
+  return translation;
+}
+
+//------------------------------------------------------------------------------
+
+/*
+  Extract a sample of sequences with LF() and locate a position in the middle of each.
+  The sequence identifiers are the same in both GBWTs, but the positions differ.
+*/
+
+size_type
+extractSequences(const GBWT& gbwt, const std::vector<size_type>& ids, std::vector<edge_type>& middle,
+                 const std::string& header)
+{
+  middle.clear();
+  double start = readTimer();
+  size_type total_length = 0;
+  std::vector<edge_type> path;
+  for(size_type id : ids)
+  {
+    path.clear();
+    edge_type position = gbwt.LF(ENDMARKER, id);
+    while(position.first != ENDMARKER)
+    {
+      path.push_back(position);
+      position = gbwt.LF(position);
+    }
+    total_length += path.size();
+    if(!(path.empty())) { middle.push_back(path[path.size() / 2]); }
+  }
+  double seconds = readTimer() - start;
+  printTime(header, total_length, seconds);
+  return total_length;
+}
+
+size_type
+locatePositions(const GBWT& gbwt, const std::vector<edge_type>& positions, const std::string& header)
+{
+  double start = readTimer();
+  size_type checksum = 0;
+  for(edge_type position : positions) { checksum += gbwt.locate(position); }
+  double seconds = readTimer() - start;
+  printTime(header, positions.size(), seconds);
+  return checksum;
+}
+
+void
+benchmark(const GBWT& original, const GBWT& reordered, size_type sequences)
+{
+  if(original.sequences() != reordered.sequences())
+  {
+    std::cerr << "reorder_nodes: The GBWTs contain a different number of sequences" << std::endl;
+    return;
+  }
+  if(sequences == 0 || original.sequences() == 0) { return; }
+
+  std::vector<size_type> ids;
+  size_type step = std::max(original.sequences() / sequences, (size_type)1);
+  for(size_type id = 0; id < original.sequences() && ids.size() < sequences; id += step) { ids.push_back(id); }
+
+  std::vector<edge_type> original_middle, reordered_middle;
+  size_type original_length = extractSequences(original, ids, original_middle, "LF/original");
+  size_type reordered_length = extractSequences(reordered, ids, reordered_middle, "LF/reordered");
+  size_type original_checksum = locatePositions(original, original_middle, "Locate/original");
+  size_type reordered_checksum = locatePositions(reordered, reordered_middle, "Locate/reordered");
+  std::cout << std::endl;
+
+  if(original_length != reordered_length || original_checksum != reordered_checksum)
+  {
+    std::cerr << "reorder_nodes: The GBWTs returned different results" << std::endl;
+  }
+}
+
+//------------------------------------------------------------------------------
@@ -0,0 +1,179 @@
+/*
+  Copyright (c) 2017 Genome Research Ltd.
+
+  Author: Jouni Siren <jouni.siren@iki.fi>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+
+#include "snapshot.h"
+
+#include <cstdio>
+
+namespace gbwt
+{
+
+//------------------------------------------------------------------------------
+
+GBWTSnapshot::GBWTSnapshot()
+{
+}
+
+GBWTSnapshot::record_pointer
+GBWTSnapshot::copyRecord(const DynamicRecord& record)
+{
+  if(record.empty() && record.indegree() == 0) { return emptyRecord(); }
+
+  DynamicRecord* copy = new DynamicRecord(record);
+  copy->recode();
+  return record_pointer(copy);
+}
+
+GBWTSnapshot::record_pointer
+GBWTSnapshot::emptyRecord()
+{
+  static record_pointer empty_record(new DynamicRecord());
+  return empty_record;
+}
+
+size_type
+GBWTSnapshot::serialize(std::ostream& out, sdsl::structure_tree_node* v, std::string name) const
+{
+  sdsl::structure_tree_node* child = sdsl::structure_tree::add_child(v, name, sdsl::util::class_name(*this));
+  size_type written_bytes = 0;
+
+  written_bytes += this->header.serialize(out, child, "header");
+
+  {
+    RecordArray array(this->bwt);
+    written_bytes += array.serialize(out, child, "bwt");
+  }
+
+  {
+    DASamples compressed_samples(this->bwt);
+    written_bytes += compressed_samples.serialize(out, child, "da_samples");
+  }
+
+  if(this->header.flags & GBWTHeader::FLAG_INCOMING)
+  {
+    IncomingEdges incoming(this->bwt);
+    written_bytes += incoming.serialize(out, child, "incoming");
+  }
+
+  sdsl::structure_tree::add_size(child, written_bytes);
+  return written_bytes;
+}
+
+//------------------------------------------------------------------------------
+
+size_type
+GBWTSnapshot::runs() const
+{
+  size_type total = 0;
+  for(const record_pointer& node : this->bwt) { total += node->runs(); }
+  return total;
+}
+
+size_type
+GBWTSnapshot::samples() const
+{
+  size_type total = 0;
+  for(const record_pointer& node : this->bwt) { total += node->samples(); }
+  return total;
+}
+
+//------------------------------------------------------------------------------
+
+size_type
+GBWTSnapshot::tryLocate(node_type node, size_type i) const
+{
+  const DynamicRecord& record = this->record(node);
+  for(sample_type sample : record.ids)
+  {
+    if(sample.first == i) { return sample.second; }
+    if(sample.first > i) { break; }
+  }
+  return invalid_sequence();
+}
+
+size_type
+GBWTSnapshot::locate(node_type node, size_type i) const
+{
+  if(!(this->contains(node))) { return invalid_sequence(); }
+
+  while(true)
+  {
+    size_type result = this->tryLocate(node, i);
+    if(result != invalid_sequence()) { return result; }
+    std::tie(node, i) = this->LF(node, i);
+  }
+}
+
+//------------------------------------------------------------------------------
+
+void
+printStatistics(const GBWTSnapshot& snapshot, const std::string& name)
+{
+  printHeader("GBWT snapshot"); std::cout << name << std::endl;
+  printHeader("Total length"); std::cout << snapshot.size() << std::endl;
+  printHeader("Sequences"); std::cout << snapshot.sequences() << std::endl;
+  printHeader("Alphabet size"); std::cout << snapshot.sigma() << std::endl;
+  printHeader("Effective"); std::cout << snapshot.effective() << std::endl;
+  printHeader("Runs"); std::cout << snapshot.runs() << std::endl;
+  printHeader("Samples"); std::cout << snapshot.samples() << std::endl;
+  std::cout << std::endl;
+}
+
+bool
+storeSnapshot(const GBWTSnapshot& snapshot, const std::string& filename)
+{
+  static std::atomic<size_type> counter(0);
+  std::string temp_file = filename + ".tmp." + sdsl::util::to_string(sdsl::util::pid())
+                        + "." + sdsl::util::to_string(counter++);
+
+  {
+    std::ofstream out(temp_file, std::ios_base::binary);
+    if(!out)
+    {
+      std::cerr << "storeSnapshot(): Cannot open temporary file " << temp_file << std::endl;
+      return false;
+    }
+    snapshot.serialize(out);
+    out.close();
+    if(out.fail())
+    {
+      std::cerr << "storeSnapshot(): Cannot write temporary file " << temp_file << std::endl;
+      std::remove(temp_file.c_str());
+      return false;
+    }
+  }
+
+  if(std::rename(temp_file.c_str(), filename.c_str()) != 0)
+  {
+    std::cerr << "storeSnapshot(): Cannot rename " << temp_file << " to " << filename << std::endl;
+    std::remove(temp_file.c_str());
+    return false;
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+} // namespace gbwt
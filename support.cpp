@@ -24,11 +24,147 @@
 
 #include "internal.h"
 
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
 namespace gbwt
 {
 
 //------------------------------------------------------------------------------
 
+PairVector::PairVector() :
+  data(nullptr), elements(0), allocated(0)
+{
+#ifndef GBWT_SAVE_MEMORY
+  this->allocated = WIDE_FLAG;
+#endif
+}
+
+PairVector::PairVector(const PairVector& source) :
+  data(nullptr), elements(0), allocated(0)
+{
+  *this = source;
+}
+
+PairVector::PairVector(PairVector&& source) :
+  data(nullptr), elements(0), allocated(0)
+{
+  this->swap(source);
+}
+
+PairVector::~PairVector()
+{
+  std::free(this->data);
+}
+
+void
+PairVector::swap(PairVector& another)
+{
+  if(this != &another)
+  {
+    std::swap(this->data, another.data);
+    std::swap(this->elements, another.elements);
+    std::swap(this->allocated, another.allocated);
+  }
+}
+
+PairVector&
+PairVector::operator=(const PairVector& source)
+{
+  if(this != &source)
+  {
+    std::free(this->data); this->data = nullptr;
+    this->elements = 0; this->allocated = (source.allocated & WIDE_FLAG);
+    this->reserve(source.size());
+    if(source.size() > 0) { std::memcpy(this->data, source.data, source.size() * source.elementBytes()); }
+    this->elements = source.size();
+  }
+  return *this;
+}
+
+PairVector&
+PairVector::operator=(PairVector&& source)
+{
+  if(this != &source)
+  {
+    std::free(this->data); this->data = nullptr;
+    this->elements = 0; this->allocated = (source.allocated & WIDE_FLAG);
+    this->swap(source);
+  }
+  return *this;
+}
+
+void
+PairVector::assign(const std::vector<value_type>& source)
+{
+  this->clear();
+  this->reserve(source.size());
+  for(value_type value : source) { this->push_back(value); }
+}
+
+void
+PairVector::insert(size_type i, value_type value)
+{
+  this->push_back(value); // Makes room and widens the vector if necessary.
+  if(i + 1 < this->size())
+  {
+    byte_type* ptr = static_cast<byte_type*>(this->data) + i * this->elementBytes();
+    std::memmove(ptr + this->elementBytes(), ptr, (this->size() - 1 - i) * this->elementBytes());
+    this->write(i, value);
+  }
+}
+
+void
+PairVector::resize(size_type n)
+{
+  this->reserve(n);
+  if(n > this->size())
+  {
+    byte_type* ptr = static_cast<byte_type*>(this->data) + this->size() * this->elementBytes();
+    std::memset(ptr, 0, (n - this->size()) * this->elementBytes());
+  }
+  this->elements = n;
+}
+
+void
+PairVector::reserve(size_type n)
+{
+  if(n <= this->capacity()) { return; }
+  void* new_data = std::realloc(this->data, n * this->elementBytes());
+  if(new_data == nullptr) { throw std::bad_alloc(); }
+  this->data = new_data;
+  this->allocated = (this->allocated & WIDE_FLAG) | n;
+}
+
+void
+PairVector::widen()
+{
+  if(this->wide()) { return; }
+  size_type* new_data = nullptr;
+  if(this->capacity() > 0)
+  {
+    new_data = static_cast<size_type*>(std::malloc(2 * this->capacity() * sizeof(size_type)));
+    if(new_data == nullptr) { throw std::bad_alloc(); }
+    const short_type* old_data = static_cast<const short_type*>(this->data);
+    for(size_type i = 0; i < 2 * this->size(); i++) { new_data[i] = old_data[i]; }
+  }
+  std::free(this->data);
+  this->data = new_data;
+  this->allocated |= WIDE_FLAG;
+}
+
+std::ostream&
+operator<<(std::ostream& out, const PairVector& data)
+{
+  out << "{ ";
+  for(PairVector::value_type element : data) { out << element << " "; }
+  out << "}";
+  return out;
+}
+
+//------------------------------------------------------------------------------
+
 void
 DynamicRecord::clear()
 {
@@ -46,6 +182,7 @@ DynamicRecord::swap(DynamicRecord& another)
     this->outgoing.swap(another.outgoing);
     this->body.swap(another.body);
     this->ids.swap(another.ids);
+    std::swap(this->sorted_outgoing, another.sorted_outgoing);
   }
 }
 
@@ -61,11 +198,22 @@ DynamicRecord::recode()
   {
     if(this->successor(outrank) < this->successor(outrank - 1)) { sorted = false; break; }
   }
-  if(sorted) { return; }
+  if(sorted) { this->sorted_outgoing = true; return; }
 
-  for(run_type& run : this->body) { run.first = this->successor(run.first); }
-  sequentialSort(this->outgoing.begin(), this->outgoing.end());
-  for(run_type& run : this->body) { run.first = this->edgeTo(run.first); }
+  std::vector<node_type> successors(this->outdegree());
+  std::vector<edge_type> edges(this->outdegree());
+  for(rank_type outrank = 0; outrank < this->outdegree(); outrank++)
+  {
+    successors[outrank] = this->successor(outrank); edges[outrank] = this->outgoing[outrank];
+  }
+  sequentialSort(edges.begin(), edges.end());
+  this->outgoing.assign(edges);
+  this->sorted_outgoing = true;
+  for(size_type i = 0; i < this->runs(); i++)
+  {
+    run_type run = this->body[i];
+    this->body.set(i, run_type(this->edgeTo(successors[run.first]), run.second));
+  }
 }
 
 //------------------------------------------------------------------------------
@@ -75,19 +223,35 @@ DynamicRecord::LF(size_type i) const
 {
   if(i >= this->size()) { return invalid_edge(); }
 
-  std::vector<edge_type> result(this->outgoing);
-  rank_type last_edge = 0;
+  // With a small outdegree, accumulate the ranks of all edges on the stack in a single pass.
+  if(this->outdegree() <= SMALL_OUTDEGREE)
+  {
+    size_type ranks[SMALL_OUTDEGREE];
+    for(rank_type outrank = 0; outrank < this->outdegree(); outrank++) { ranks[outrank] = 0; }
+    rank_type last_edge = 0;
+    size_type offset = 0;
+    for(run_type run : this->body)
+    {
+      last_edge = run.first;
+      ranks[run.first] += run.second;
+      offset += run.second;
+      if(offset > i) { break; }
+    }
+    return edge_type(this->successor(last_edge), this->offset(last_edge) + ranks[last_edge] - (offset - i));
+  }
+
+  // Otherwise find the run covering offset i and then count the earlier occurrences of its outrank.
+  PairVector::const_iterator iter = this->body.begin();
   size_type offset = 0;
-  for(run_type run : this->body)
+  while(offset + iter->second <= i) { offset += iter->second; ++iter; }
+  rank_type outrank = iter->first;
+  size_type result = this->offset(outrank) + (i - offset);
+  for(PairVector::const_iterator prev = this->body.begin(); prev != iter; ++prev)
   {
-    last_edge = run.first;
-    result[run.first].second += run.second;
-    offset += run.second;
-    if(offset > i) { break; }
+    result += (prev->first == outrank ? prev->second : 0);
   }
 
-  result[last_edge].second -= (offset - i);
-  return result[last_edge];
+  return edge_type(this->successor(outrank), result);
 }
 
 size_type
@@ -118,7 +282,7 @@ DynamicRecord::LF(range_type range, node_type to) const
   size_type outrank = this->edgeTo(to);
   if(outrank >= this->outdegree()) { return Range::empty_range(); }
 
-  std::vector<run_type>::const_iterator iter = this->body.begin();
+  PairVector::const_iterator iter = this->body.begin();
   run_type run = *iter;
   size_type result = this->offset(outrank) + (run.first == outrank ? run.second : 0), offset = run.second;
 
@@ -132,7 +296,7 @@ DynamicRecord::LF(range_type range, node_type to) const
   }
   range.first = result - (run.first == outrank ? offset - range.first : 0);
 
-  while(iter != body.end() && offset < range.second)
+  while(iter != body.end() && offset < range.second + 1)
   {
     ++iter;
     if(iter == body.end()) { break; }
@@ -140,7 +304,7 @@ DynamicRecord::LF(range_type range, node_type to) const
     if(run.first == outrank) { result += run.second; }
     offset += run.second;
   }
-  range.second = result - (run.first == outrank ? offset - range.second : 0);
+  range.second = result - (run.first == outrank ? offset - (range.second + 1) : 0) - 1;
 
   return range;
 }
@@ -160,11 +324,58 @@ DynamicRecord::operator[](size_type i) const
   return ENDMARKER;
 }
 
+size_type
+DynamicRecord::countSmaller(range_type range, node_type to) const
+{
+  if(Range::empty(range)) { return 0; }
+
+  size_type result = 0, offset = 0;
+  for(run_type run : this->body)
+  {
+    size_type next_offset = offset + run.second;
+    if(next_offset > range.first && this->successor(run.first) < to)
+    {
+      result += std::min(next_offset, range.second + 1) - std::max(offset, range.first);
+    }
+    offset = next_offset;
+    if(offset > range.second) { break; }
+  }
+
+  return result;
+}
+
+size_type
+DynamicRecord::select(size_type k, node_type to) const
+{
+  size_type outrank = this->edgeTo(to);
+  if(outrank >= this->outdegree()) { return invalid_offset(); }
+
+  size_type offset = 0, count = 0;
+  for(run_type run : this->body)
+  {
+    if(run.first == outrank)
+    {
+      if(count + run.second > k) { return offset + (k - count); }
+      count += run.second;
+    }
+    offset += run.second;
+  }
+
+  return invalid_offset();
+}
+
 //------------------------------------------------------------------------------
 
 rank_type
 DynamicRecord::edgeTo(node_type to) const
 {
+  if(this->sorted_outgoing && this->outdegree() > SMALL_OUTDEGREE)
+  {
+    PairVector::const_iterator iter = std::lower_bound(this->outgoing.begin(), this->outgoing.end(), to,
+      [](edge_type edge, node_type node) { return (edge.first < node); });
+    if(iter == this->outgoing.end() || iter->first != to) { return this->outdegree(); }
+    return iter - this->outgoing.begin();
+  }
   for(rank_type outrank = 0; outrank < this->outdegree(); outrank++)
   {
     if(this->successor(outrank) == to) { return outrank; }
@@ -177,28 +388,23 @@ DynamicRecord::edgeTo(node_type to) const
 rank_type
 DynamicRecord::findFirst(node_type from) const
 {
-  for(size_type i = 0; i < this->indegree(); i++)
-  {
-    if(this->incoming[i].first >= from) { return i; }
-  }
-  return this->indegree();
+  PairVector::const_iterator iter = std::lower_bound(this->incoming.begin(), this->incoming.end(), from,
+    [](edge_type edge, node_type node) { return (edge.first < node); });
+  return iter - this->incoming.begin();
 }
 
 void
 DynamicRecord::increment(node_type from)
 {
-  for(rank_type inrank = 0; inrank < this->indegree(); inrank++)
-  {
-    if(this->predecessor(inrank) == from) { this->count(inrank)++; return; }
-  }
-  this->addIncoming(edge_type(from, 1));
+  rank_type inrank = this->findFirst(from);
+  if(inrank < this->indegree() && this->predecessor(inrank) == from) { this->setCount(inrank, this->count(inrank) + 1); }
+  else { this->incoming.insert(inrank, edge_type(from, 1)); }
 }
 
 void
 DynamicRecord::addIncoming(edge_type inedge)
 {
-  this->incoming.push_back(inedge);
-  sequentialSort(this->incoming.begin(), this->incoming.end());
+  this->incoming.insert(this->findFirst(inedge.first), inedge);
 }
 
 //------------------------------------------------------------------------------
@@ -220,6 +426,11 @@ operator<<(std::ostream& out, const DynamicRecord& record)
 
 //------------------------------------------------------------------------------
 
+CompressedRecord::CompressedRecord() :
+  body(nullptr), data_size(0)
+{
+}
+
 CompressedRecord::CompressedRecord(const std::vector<byte_type>& source, size_type start, size_type limit)
 {
   this->outgoing.resize(ByteCode::read(source, start));
@@ -231,144 +442,641 @@ CompressedRecord::CompressedRecord(const std::vector<byte_type>& source, size_ty
     outedge.second = ByteCode::read(source, start);
   }
 
-  this->body = source.data() + start;
-  this->data_size = limit - start;
+  this->body = source.data() + start;
+  this->data_size = limit - start;
+}
+
+/*
+  Most records have a small outdegree. The queries on such records use a run decoder
+  specialized for the outdegree. Query<Decoder>::apply(record, args...) implements the
+  query using the given decoder. The record must have outgoing edges.
+*/
+
+template<template<class> class Query, class... Args>
+auto
+withDecoder(const CompressedRecord& record, Args... args) -> decltype(Query<Run>::apply(record, args...))
+{
+  switch(record.outdegree())
+  {
+  case 1:
+    return Query<FixedRun<1>>::apply(record, args...);
+  case 2:
+    return Query<FixedRun<2>>::apply(record, args...);
+  case 3:
+    return Query<FixedRun<3>>::apply(record, args...);
+  case 4:
+    return Query<FixedRun<4>>::apply(record, args...);
+  default:
+    return Query<Run>::apply(record, args...);
+  }
+}
+
+template<class Decoder>
+struct RecordSize
+{
+  static size_type apply(const CompressedRecord& record)
+  {
+    size_type result = 0;
+    for(BasicCompressedRecordIterator<Decoder, NoRanks> iter(record); !(iter.end()); ++iter) { result += iter->second; }
+    return result;
+  }
+};
+
+template<class Decoder>
+struct RecordRuns
+{
+  static size_type apply(const CompressedRecord& record)
+  {
+    size_type result = 0;
+    for(BasicCompressedRecordIterator<Decoder, NoRanks> iter(record); !(iter.end()); ++iter) { result++; }
+    return result;
+  }
+};
+
+template<class Decoder>
+struct RecordLF
+{
+  static edge_type apply(const CompressedRecord& record, size_type i)
+  {
+    for(BasicCompressedRecordIterator<Decoder, AllRanks> iter(record); !(iter.end()); ++iter)
+    {
+      if(iter.offset() > i)
+      {
+        edge_type result = iter.edge(); result.second -= (iter.offset() - i);
+        return result;
+      }
+    }
+    return invalid_edge();
+  }
+};
+
+template<class Decoder>
+struct RecordRank
+{
+  static size_type apply(const CompressedRecord& record, size_type i, rank_type outrank)
+  {
+    BasicCompressedRecordIterator<Decoder, OutrankRank> iter(record, outrank);
+    while(!(iter.end()) && iter.offset() < i) { ++iter; }
+    return iter.rankAt(i);
+  }
+};
+
+template<class Decoder>
+struct RecordRangeRank
+{
+  static range_type apply(const CompressedRecord& record, range_type range, rank_type outrank)
+  {
+    BasicCompressedRecordIterator<Decoder, OutrankRank> iter(record, outrank);
+    while(!(iter.end()) && iter.offset() < range.first) { ++iter; }
+    range.first = iter.rankAt(range.first);
+    while(!(iter.end()) && iter.offset() < range.second + 1) { ++iter; }
+    range.second = iter.rankAt(range.second + 1) - 1;
+    return range;
+  }
+};
+
+template<class Decoder>
+struct RecordAccess
+{
+  static node_type apply(const CompressedRecord& record, size_type i)
+  {
+    for(BasicCompressedRecordIterator<Decoder, NoRanks> iter(record); !(iter.end()); ++iter)
+    {
+      if(iter.offset() > i) { return record.successor(iter->first); }
+    }
+    return ENDMARKER;
+  }
+};
+
+template<class Decoder>
+struct RecordSelect
+{
+  static size_type apply(const CompressedRecord& record, size_type k, rank_type outrank)
+  {
+    size_type count = 0;
+    for(BasicCompressedRecordIterator<Decoder, NoRanks> iter(record); !(iter.end()); ++iter)
+    {
+      if(iter->first == outrank)
+      {
+        if(count + iter->second > k) { return iter.offset() - iter->second + (k - count); }
+        count += iter->second;
+      }
+    }
+    return invalid_offset();
+  }
+};
+
+size_type
+CompressedRecord::size() const
+{
+  if(this->outdegree() == 0) { return 0; }
+  return withDecoder<RecordSize>(*this);
+}
+
+size_type
+CompressedRecord::runs() const
+{
+  if(this->outdegree() == 0) { return 0; }
+  return withDecoder<RecordRuns>(*this);
+}
+
+edge_type
+CompressedRecord::LF(size_type i) const
+{
+  if(this->outdegree() == 0) { return invalid_edge(); }
+  return withDecoder<RecordLF>(*this, i);
+}
+
+size_type
+CompressedRecord::LF(size_type i, node_type to) const
+{
+  size_type outrank = this->edgeTo(to);
+  if(outrank >= this->outdegree()) { return invalid_offset(); }
+  return withDecoder<RecordRank>(*this, i, outrank);
+}
+
+range_type
+CompressedRecord::LF(range_type range, node_type to) const
+{
+  if(Range::empty(range)) { return Range::empty_range(); }
+
+  size_type outrank = this->edgeTo(to);
+  if(outrank >= this->outdegree()) { return Range::empty_range(); }
+  return withDecoder<RecordRangeRank>(*this, range, outrank);
+}
+
+node_type
+CompressedRecord::operator[](size_type i) const
+{
+  if(this->outdegree() == 0) { return ENDMARKER; }
+  return withDecoder<RecordAccess>(*this, i);
+}
+
+size_type
+CompressedRecord::select(size_type k, node_type to) const
+{
+  size_type outrank = this->edgeTo(to);
+  if(outrank >= this->outdegree()) { return invalid_offset(); }
+  return withDecoder<RecordSelect>(*this, k, outrank);
+}
+
+rank_type
+CompressedRecord::edgeTo(node_type to) const
+{
+  // The outgoing edges of a compressed record are sorted by destination.
+  if(this->outdegree() > SMALL_OUTDEGREE)
+  {
+    std::vector<edge_type>::const_iterator iter = std::lower_bound(this->outgoing.begin(), this->outgoing.end(), to,
+      [](const edge_type& edge, node_type node) { return (edge.first < node); });
+    if(iter == this->outgoing.end() || iter->first != to) { return this->outdegree(); }
+    return iter - this->outgoing.begin();
+  }
+  for(rank_type outrank = 0; outrank < this->outdegree(); outrank++)
+  {
+    if(this->successor(outrank) == to) { return outrank; }
+  }
+  return this->outdegree();
+}
+
+//------------------------------------------------------------------------------
+
+DecodedRecord::DecodedRecord()
+{
+}
+
+DecodedRecord::DecodedRecord(const CompressedRecord& record) :
+  outgoing(record.outgoing)
+{
+  this->run_starts.push_back(0);
+  if(record.outdegree() == 0) { return; }
+
+  std::vector<size_type> counts(this->outdegree(), 0);
+  for(CompressedRecordIterator iter(record); !(iter.end()); ++iter)
+  {
+    this->run_outranks.push_back(iter->first);
+    this->run_ranks.push_back(counts[iter->first]);
+    this->run_starts.push_back(iter.offset());
+    counts[iter->first] += iter->second;
+  }
+
+  // Group the runs by outrank.
+  this->outrank_starts = std::vector<size_type>(this->outdegree() + 1, 0);
+  for(rank_type outrank : this->run_outranks) { this->outrank_starts[outrank + 1]++; }
+  for(size_type outrank = 0; outrank < this->outdegree(); outrank++)
+  {
+    this->outrank_starts[outrank + 1] += this->outrank_starts[outrank];
+  }
+  this->outrank_runs.resize(this->runs());
+  std::vector<size_type> tails(this->outrank_starts.begin(), this->outrank_starts.end() - 1);
+  for(size_type run = 0; run < this->runs(); run++)
+  {
+    this->outrank_runs[tails[this->run_outranks[run]]] = run; tails[this->run_outranks[run]]++;
+  }
+}
+
+size_type
+DecodedRecord::bytes() const
+{
+  return bytes(this->outdegree(), this->runs());
+}
+
+size_type
+DecodedRecord::bytes(size_type outdegree, size_type runs)
+{
+  return sizeof(DecodedRecord) + outdegree * (sizeof(edge_type) + sizeof(size_type))
+       + runs * (3 * sizeof(size_type) + sizeof(rank_type)) + 2 * sizeof(size_type);
+}
+
+size_type
+DecodedRecord::runAt(size_type i) const
+{
+  return std::upper_bound(this->run_starts.begin(), this->run_starts.end(), i) - this->run_starts.begin() - 1;
+}
+
+size_type
+DecodedRecord::rank(size_type i, rank_type outrank) const
+{
+  // Find the last run of the outrank starting before offset i.
+  std::vector<size_type>::const_iterator first = this->outrank_runs.begin() + this->outrank_starts[outrank];
+  std::vector<size_type>::const_iterator last = this->outrank_runs.begin() + this->outrank_starts[outrank + 1];
+  std::vector<size_type>::const_iterator iter = std::partition_point(first, last, [this, i](size_type run)
+  {
+    return (this->run_starts[run] < i);
+  });
+  if(iter == first) { return 0; }
+  --iter;
+  size_type run = *iter;
+  return this->run_ranks[run] + std::min(i, this->run_starts[run + 1]) - this->run_starts[run];
+}
+
+edge_type
+DecodedRecord::LF(size_type i) const
+{
+  if(i >= this->size()) { return invalid_edge(); }
+
+  size_type run = this->runAt(i);
+  rank_type outrank = this->run_outranks[run];
+  return edge_type(this->successor(outrank),
+                   this->offset(outrank) + this->run_ranks[run] + (i - this->run_starts[run]));
+}
+
+size_type
+DecodedRecord::LF(size_type i, node_type to) const
+{
+  rank_type outrank = this->edgeTo(to);
+  if(outrank >= this->outdegree()) { return invalid_offset(); }
+  return this->offset(outrank) + this->rank(i, outrank);
+}
+
+range_type
+DecodedRecord::LF(range_type range, node_type to) const
+{
+  if(Range::empty(range)) { return Range::empty_range(); }
+
+  rank_type outrank = this->edgeTo(to);
+  if(outrank >= this->outdegree()) { return Range::empty_range(); }
+
+  range.first = this->offset(outrank) + this->rank(range.first, outrank);
+  range.second = this->offset(outrank) + this->rank(range.second + 1, outrank) - 1;
+  return range;
+}
+
+node_type
+DecodedRecord::operator[](size_type i) const
+{
+  if(i >= this->size()) { return ENDMARKER; }
+  return this->successor(this->run_outranks[this->runAt(i)]);
+}
+
+rank_type
+DecodedRecord::edgeTo(node_type to) const
+{
+  // The outgoing edges of a compressed record are sorted by destination.
+  std::vector<edge_type>::const_iterator iter = std::lower_bound(this->outgoing.begin(), this->outgoing.end(), to,
+    [](const edge_type& edge, node_type node) { return (edge.first < node); });
+  if(iter == this->outgoing.end() || iter->first != to) { return this->outdegree(); }
+  return iter - this->outgoing.begin();
+}
+
+//------------------------------------------------------------------------------
+
+/*
+  The compressed structures can be built from the records of a DynamicGBWT or from
+  the shared records of a GBWTSnapshot.
+*/
+
+inline const DynamicRecord&
+recordAt(const std::vector<DynamicRecord>& bwt, size_type i)
+{
+  return bwt[i];
+}
+
+inline const DynamicRecord&
+recordAt(const std::vector<std::shared_ptr<const DynamicRecord>>& bwt, size_type i)
+{
+  return *(bwt[i]);
+}
+
+inline const PairVector&
+incomingAt(const std::vector<DynamicRecord>& bwt, size_type i)
+{
+  return bwt[i].incoming;
+}
+
+inline const PairVector&
+incomingAt(const std::vector<std::shared_ptr<const DynamicRecord>>& bwt, size_type i)
+{
+  return bwt[i]->incoming;
+}
+
+inline const std::vector<edge_type>&
+incomingAt(const std::vector<std::vector<edge_type>>& incoming, size_type i)
+{
+  return incoming[i];
+}
+
+//------------------------------------------------------------------------------
+
+RecordArray::RecordArray() :
+  records(0)
+{
+}
+
+RecordArray::RecordArray(const RecordArray& source)
+{
+  this->copy(source);
+}
+
+RecordArray::RecordArray(RecordArray&& source)
+{
+  *this = std::move(source);
+}
+
+RecordArray::~RecordArray()
+{
+}
+
+RecordArray::RecordArray(const std::vector<DynamicRecord>& bwt) :
+  records(bwt.size())
+{
+  this->build(bwt);
+}
+
+RecordArray::RecordArray(const std::vector<std::shared_ptr<const DynamicRecord>>& bwt) :
+  records(bwt.size())
+{
+  this->build(bwt);
+}
+
+RecordArray::RecordArray(const std::vector<std::vector<byte_type>>& records) :
+  records(records.size())
+{
+  size_type total_size = 0;
+  for(const std::vector<byte_type>& record : records) { total_size += record.size(); }
+  this->data.reserve(total_size);
+
+  std::vector<size_type> offsets(records.size());
+  for(size_type i = 0; i < records.size(); i++)
+  {
+    offsets[i] = this->data.size();
+    this->data.insert(this->data.end(), records[i].begin(), records[i].end());
+  }
+  this->buildIndex(offsets);
+}
+
+template<class RecordContainer>
+void
+RecordArray::build(const RecordContainer& bwt)
+{
+  // Find the starting offsets and compress the BWT.
+  std::vector<size_type> offsets(bwt.size());
+  for(size_type i = 0; i < bwt.size(); i++)
+  {
+    offsets[i] = this->data.size();
+    const DynamicRecord& current = recordAt(bwt, i);
+    encode(this->data, current);
+  }
+  this->buildIndex(offsets);
+}
+
+void
+RecordArray::buildIndex(const std::vector<size_type>& offsets)
+{
+  sdsl::sd_vector_builder builder(this->data.size(), offsets.size());
+  for(size_type offset : offsets) { builder.set(offset); }
+  this->index = sdsl::sd_vector<>(builder);
+  sdsl::util::init_support(this->select, &(this->index));
+}
+
+template<class EdgeVector, class RunVector>
+void
+encodeRecord(std::vector<byte_type>& data, const EdgeVector& outgoing, const RunVector& body)
+{
+  // Write the outgoing edges.
+  ByteCode::write(data, outgoing.size());
+  node_type prev = 0;
+  for(edge_type outedge : outgoing)
+  {
+    ByteCode::write(data, outedge.first - prev);
+    prev = outedge.first;
+    ByteCode::write(data, outedge.second);
+  }
+
+  // Write the body.
+  if(outgoing.size() > 0)
+  {
+    Run encoder(outgoing.size());
+    for(run_type run : body) { encoder.write(data, run); }
+  }
+}
+
+void
+RecordArray::encode(std::vector<byte_type>& data, const std::vector<edge_type>& outgoing, const std::vector<run_type>& body)
+{
+  encodeRecord(data, outgoing, body);
 }
 
-size_type
-CompressedRecord::size() const
+void
+RecordArray::encode(std::vector<byte_type>& data, const DynamicRecord& record)
 {
-  size_type result = 0;
-  if(this->outdegree() > 0)
-  {
-    for(CompressedRecordIterator iter(*this); !(iter.end()); ++iter) { result += iter->second; }
-  }
-  return result;
+  encodeRecord(data, record.outgoing, record.body);
 }
 
-size_type
-CompressedRecord::runs() const
+void
+RecordArray::swap(RecordArray& another)
 {
-  size_type result = 0;
-  if(this->outdegree() > 0)
+  if(this != &another)
   {
-    for(CompressedRecordIterator iter(*this); !(iter.end()); ++iter) { result++; }
+    std::swap(this->records, another.records),
+    this->index.swap(another.index);
+    sdsl::util::swap_support(this->select, another.select, &(this->index), &(another.index));
+    this->data.swap(another.data);
+    this->directory.swap(another.directory);
   }
-  return result;
 }
 
-edge_type
-CompressedRecord::LF(size_type i) const
+RecordArray&
+RecordArray::operator=(const RecordArray& source)
 {
-  if(this->outdegree() == 0) { return invalid_edge(); }
+  if(this != &source) { this->copy(source); }
+  return *this;
+}
 
-  for(CompressedRecordFullIterator iter(*this); !(iter.end()); ++iter)
+RecordArray&
+RecordArray::operator=(RecordArray&& source)
+{
+  if(this != &source)
   {
-    if(iter.offset() > i)
-    {
-      edge_type result = iter.edge(); result.second -= (iter.offset() - i);
-      return result;
-    }
+    this->records = std::move(source.records);
+    this->index = std::move(source.index);
+    this->select = std::move(source.select); this->select.set_vector(&(this->index));
+    this->data = std::move(source.data);
+    this->directory = std::move(source.directory);
   }
-  return invalid_edge();
+  return *this;
 }
 
 size_type
-CompressedRecord::LF(size_type i, node_type to) const
+RecordArray::serialize(std::ostream& out, sdsl::structure_tree_node* v, std::string name) const
 {
-  size_type outrank = this->edgeTo(to);
-  if(outrank >= this->outdegree()) { return invalid_offset(); }
-  CompressedRecordRankIterator iter(*this, outrank);
+  sdsl::structure_tree_node* child = sdsl::structure_tree::add_child(v, name, sdsl::util::class_name(*this));
+  size_type written_bytes = 0;
+
+  written_bytes += sdsl::write_member(this->records, out, child, "records");
+  written_bytes += this->index.serialize(out, child, "index");
+  written_bytes += this->select.serialize(out, child, "select");
+
+  // Serialize the data.
+  size_type data_bytes = this->data.size() * sizeof(byte_type);
+  sdsl::structure_tree_node* data_node =
+    sdsl::structure_tree::add_child(child, "data", "std::vector<gbwt::byte_type>");
+  out.write((const char*)(this->data.data()), data_bytes);
+  sdsl::structure_tree::add_size(data_node, data_bytes);
+  written_bytes += data_bytes;
 
-  while(!(iter.end()) && iter.offset() < i) { ++iter; }
-  return iter.rankAt(i);
+  sdsl::structure_tree::add_size(child, written_bytes);
+  return written_bytes;
 }
 
-range_type
-CompressedRecord::LF(range_type range, node_type to) const
+void
+RecordArray::load(std::istream& in)
 {
-  if(Range::empty(range)) { return Range::empty_range(); }
+  sdsl::read_member(this->records, in);
 
-  size_type outrank = this->edgeTo(to);
-  if(outrank >= this->outdegree()) { return Range::empty_range(); }
-  CompressedRecordRankIterator iter(*this, outrank);
+  // Read the record index.
+  this->index.load(in);
+  this->select.load(in, &(this->index));
 
-  while(!(iter.end()) && iter.offset() < range.first) { ++iter; }
-  range.first = iter.rankAt(range.first);
-  while(!(iter.end()) && iter.offset() < range.second) { ++iter; }
-  range.second = iter.rankAt(range.second);
+  // Read the data. With huge pages, we advise and prefault the memory before touching it.
+  size_type bytes = this->index.size() * sizeof(byte_type);
+  std::vector<byte_type>().swap(this->data);
+  if(HugePages::enabled)
+  {
+    this->data.reserve(this->index.size());
+    HugePages::advise(this->data.data(), bytes);
+    HugePages::prefault(this->data.data(), bytes);
+  }
+  this->data.resize(this->index.size());
+  in.read((char*)(this->data.data()), bytes);
 
-  return range;
+  // Build the directory if the policy allows it.
+  this->clearDirectory();
+  if(Acceleration::use(this->directoryBytes())) { this->buildDirectory(); }
+  if(HugePages::enabled && this->hasDirectory()) { HugePages::collapse(this->directory); }
 }
 
-node_type
-CompressedRecord::operator[](size_type i) const
+void
+RecordArray::copy(const RecordArray& source)
 {
-  if(this->outdegree() == 0) { return ENDMARKER; }
+  this->records = source.records;
+  this->index = source.index;
+  this->select = source.select; this->select.set_vector(&(this->index));
+  this->data = source.data;
+  this->directory = source.directory;
+}
 
-  for(CompressedRecordIterator iter(*this); !(iter.end()); ++iter)
-  {
-    if(iter.offset() > i) { return this->successor(iter->first); }
-  }
-  return ENDMARKER;
+size_type
+RecordArray::directoryBytes() const
+{
+  return ((this->records + 1) * bit_length(this->data.size()) + 7) / 8;
 }
 
-rank_type
-CompressedRecord::edgeTo(node_type to) const
+void
+RecordArray::buildDirectory()
 {
-  for(rank_type outrank = 0; outrank < this->outdegree(); outrank++)
+  this->clearDirectory();
+  if(this->records == 0) { return; }
+
+  this->directory = sdsl::int_vector<0>(this->records + 1, 0, bit_length(this->data.size()));
+  for(size_type record = 0; record < this->records; record++)
   {
-    if(this->successor(outrank) == to) { return outrank; }
+    this->directory[record] = this->select(record + 1);
   }
-  return this->outdegree();
+  this->directory[this->records] = this->data.size();
+}
+
+void
+RecordArray::clearDirectory()
+{
+  sdsl::util::clear(this->directory);
 }
 
 //------------------------------------------------------------------------------
 
-RecordArray::RecordArray() :
+IncomingEdges::IncomingEdges() :
   records(0)
 {
 }
 
-RecordArray::RecordArray(const RecordArray& source)
+IncomingEdges::IncomingEdges(const IncomingEdges& source)
 {
   this->copy(source);
 }
 
-RecordArray::RecordArray(RecordArray&& source)
+IncomingEdges::IncomingEdges(IncomingEdges&& source)
 {
   *this = std::move(source);
 }
 
-RecordArray::~RecordArray()
+IncomingEdges::~IncomingEdges()
 {
 }
 
-RecordArray::RecordArray(const std::vector<DynamicRecord>& bwt) :
+IncomingEdges::IncomingEdges(const std::vector<DynamicRecord>& bwt) :
   records(bwt.size())
 {
-  // Find the starting offsets and compress the BWT.
+  this->build(bwt);
+}
+
+IncomingEdges::IncomingEdges(const std::vector<std::shared_ptr<const DynamicRecord>>& bwt) :
+  records(bwt.size())
+{
+  this->build(bwt);
+}
+
+IncomingEdges::IncomingEdges(const std::vector<std::vector<edge_type>>& incoming) :
+  records(incoming.size())
+{
+  this->build(incoming);
+}
+
+template<class RecordContainer>
+void
+IncomingEdges::build(const RecordContainer& bwt)
+{
+  // Find the starting offsets and compress the incoming edges.
   std::vector<size_type> offsets(bwt.size());
   for(size_type i = 0; i < bwt.size(); i++)
   {
     offsets[i] = this->data.size();
-    const DynamicRecord& current = bwt[i];
-
-    // Write the outgoing edges.
-    ByteCode::write(this->data, current.outdegree());
+    const auto& incoming = incomingAt(bwt, i);
+    ByteCode::write(this->data, incoming.size());
     node_type prev = 0;
-    for(edge_type outedge : current.outgoing)
+    for(edge_type inedge : incoming)
     {
-      ByteCode::write(this->data, outedge.first - prev);
-      prev = outedge.first;
-      ByteCode::write(this->data, outedge.second);
-    }
-
-    // Write the body.
-    if(current.outdegree() > 0)
-    {
-      Run encoder(current.outdegree());
-      for(run_type run : current.body) { encoder.write(this->data, run); }
+      ByteCode::write(this->data, inedge.first - prev);
+      prev = inedge.first;
+      ByteCode::write(this->data, inedge.second);
     }
   }
 
@@ -380,26 +1088,26 @@ RecordArray::RecordArray(const std::vector<DynamicRecord>& bwt) :
 }
 
 void
-RecordArray::swap(RecordArray& another)
+IncomingEdges::swap(IncomingEdges& another)
 {
   if(this != &another)
   {
-    std::swap(this->records, another.records),
+    std::swap(this->records, another.records);
     this->index.swap(another.index);
     sdsl::util::swap_support(this->select, another.select, &(this->index), &(another.index));
     this->data.swap(another.data);
   }
 }
 
-RecordArray&
-RecordArray::operator=(const RecordArray& source)
+IncomingEdges&
+IncomingEdges::operator=(const IncomingEdges& source)
 {
   if(this != &source) { this->copy(source); }
   return *this;
 }
 
-RecordArray&
-RecordArray::operator=(RecordArray&& source)
+IncomingEdges&
+IncomingEdges::operator=(IncomingEdges&& source)
 {
   if(this != &source)
   {
@@ -412,7 +1120,7 @@ RecordArray::operator=(RecordArray&& source)
 }
 
 size_type
-RecordArray::serialize(std::ostream& out, sdsl::structure_tree_node* v, std::string name) const
+IncomingEdges::serialize(std::ostream& out, sdsl::structure_tree_node* v, std::string name) const
 {
   sdsl::structure_tree_node* child = sdsl::structure_tree::add_child(v, name, sdsl::util::class_name(*this));
   size_type written_bytes = 0;
@@ -434,7 +1142,7 @@ RecordArray::serialize(std::ostream& out, sdsl::structure_tree_node* v, std::str
 }
 
 void
-RecordArray::load(std::istream& in)
+IncomingEdges::load(std::istream& in)
 {
   sdsl::read_member(this->records, in);
 
@@ -448,7 +1156,7 @@ RecordArray::load(std::istream& in)
 }
 
 void
-RecordArray::copy(const RecordArray& source)
+IncomingEdges::copy(const IncomingEdges& source)
 {
   this->records = source.records;
   this->index = source.index;
@@ -456,6 +1164,174 @@ RecordArray::copy(const RecordArray& source)
   this->data = source.data;
 }
 
+edge_type
+IncomingEdges::predecessor(size_type record, size_type i) const
+{
+  if(record >= this->records) { return invalid_edge(); }
+
+  size_type pos = this->start(record);
+  size_type indegree = ByteCode::read(this->data, pos);
+  node_type from = 0;
+  size_type offset = 0;
+  for(rank_type inrank = 0; inrank < indegree; inrank++)
+  {
+    from += ByteCode::read(this->data, pos);
+    size_type count = ByteCode::read(this->data, pos);
+    if(offset + count > i) { return edge_type(from, offset); }
+    offset += count;
+  }
+
+  return invalid_edge();
+}
+
+//------------------------------------------------------------------------------
+
+EndmarkerIndex::EndmarkerIndex() :
+  sequences(0)
+{
+}
+
+EndmarkerIndex::EndmarkerIndex(const DynamicRecord& record) :
+  sequences(0)
+{
+  this->build(record.outgoing, record.body);
+}
+
+EndmarkerIndex::EndmarkerIndex(const CompressedRecord& record) :
+  sequences(0)
+{
+  std::vector<run_type> body;
+  if(record.outdegree() > 0)
+  {
+    for(CompressedRecordIterator iter(record); !(iter.end()); ++iter) { body.push_back(*iter); }
+  }
+  this->build(record.outgoing, body);
+}
+
+void
+EndmarkerIndex::swap(EndmarkerIndex& another)
+{
+  if(this != &another)
+  {
+    this->nodes.swap(another.nodes);
+    this->offsets.swap(another.offsets);
+    this->counts.swap(another.counts);
+    std::swap(this->sequences, another.sequences);
+  }
+}
+
+// Make room for 'n' values of the given width while keeping the first 'used' values.
+void
+growVector(sdsl::int_vector<0>& vec, size_type used, size_type n, size_type width)
+{
+  width = std::max(width, static_cast<size_type>(1));
+  if(used > 0) { width = std::max(width, static_cast<size_type>(vec.width())); }
+  if(n <= vec.size() && width == vec.width()) { return; }
+
+  sdsl::int_vector<0> result(std::max(n, 2 * used), 0, width);
+  for(size_type i = 0; i < used; i++) { result[i] = vec[i]; }
+  vec.swap(result);
+}
+
+void
+EndmarkerIndex::extend(const DynamicRecord& record, size_type new_sequences)
+{
+  if(new_sequences == 0) { return; }
+
+  // Find the runs for the new sequences at the end of the body.
+  std::vector<run_type> tail;
+  size_type remaining = new_sequences;
+  for(size_type i = record.runs(); remaining > 0; )
+  {
+    i--; run_type run = record.body[i];
+    if(run.second > remaining) { run.second = remaining; }
+    tail.push_back(run); remaining -= run.second;
+  }
+  std::reverse(tail.begin(), tail.end());
+
+  // Find the count for each outrank used by the new sequences. New start nodes are appended.
+  std::vector<size_type> added(record.outdegree(), 0), positions(record.outdegree(), 0);
+  for(run_type run : tail) { added[run.first] += run.second; }
+  size_type old_counts = this->counts.size();
+  node_type max_node = 0;
+  size_type max_offset = 0;
+  for(rank_type outrank = 0; outrank < record.outdegree(); outrank++)
+  {
+    if(added[outrank] == 0) { continue; }
+    node_type node = record.successor(outrank);
+    auto iter = std::lower_bound(this->counts.begin(), this->counts.begin() + old_counts, edge_type(node, 0));
+    if(iter != this->counts.begin() + old_counts && iter->first == node) { positions[outrank] = iter - this->counts.begin(); }
+    else { positions[outrank] = this->counts.size(); this->counts.push_back(edge_type(node, 0)); }
+    max_node = std::max(node, max_node);
+    max_offset = std::max(record.offset(outrank) + this->counts[positions[outrank]].second + added[outrank] - 1, max_offset);
+  }
+
+  size_type new_size = this->size() + new_sequences;
+  growVector(this->nodes, this->size(), new_size, bit_length(max_node));
+  growVector(this->offsets, this->size(), new_size, bit_length(max_offset));
+  for(run_type run : tail)
+  {
+    edge_type& count = this->counts[positions[run.first]];
+    for(size_type i = 0; i < run.second; i++, this->sequences++)
+    {
+      this->nodes[this->sequences] = count.first;
+      this->offsets[this->sequences] = record.offset(run.first) + count.second; count.second++;
+    }
+  }
+  if(this->counts.size() > old_counts)
+  {
+    std::sort(this->counts.begin() + old_counts, this->counts.end());
+    std::inplace_merge(this->counts.begin(), this->counts.begin() + old_counts, this->counts.end());
+  }
+}
+
+size_type
+EndmarkerIndex::count(node_type node) const
+{
+  auto iter = std::lower_bound(this->counts.begin(), this->counts.end(), edge_type(node, 0));
+  return (iter != this->counts.end() && iter->first == node ? iter->second : 0);
+}
+
+template<class EdgeVector, class RunVector>
+void
+EndmarkerIndex::build(const EdgeVector& outgoing, const RunVector& body)
+{
+  size_type total = 0;
+  node_type max_node = 0;
+  size_type max_offset = 0;
+  std::vector<size_type> ranks(outgoing.size(), 0);
+  for(run_type run : body)
+  {
+    total += run.second; ranks[run.first] += run.second;
+  }
+  for(rank_type outrank = 0; outrank < outgoing.size(); outrank++)
+  {
+    max_node = std::max((node_type)(outgoing[outrank].first), max_node);
+    max_offset = std::max((size_type)(outgoing[outrank].second) + ranks[outrank], max_offset);
+  }
+
+  this->nodes = sdsl::int_vector<0>(total, 0, bit_length(max_node));
+  this->offsets = sdsl::int_vector<0>(total, 0, bit_length(max_offset));
+  this->sequences = total;
+  this->counts.clear();
+  for(rank_type outrank = 0; outrank < outgoing.size(); outrank++)
+  {
+    this->counts.push_back(edge_type(outgoing[outrank].first, ranks[outrank]));
+    ranks[outrank] = outgoing[outrank].second;
+  }
+  std::sort(this->counts.begin(), this->counts.end());
+
+  size_type sequence = 0;
+  for(run_type run : body)
+  {
+    for(size_type i = 0; i < run.second; i++, sequence++)
+    {
+      this->nodes[sequence] = outgoing[run.first].first;
+      this->offsets[sequence] = ranks[run.first]; ranks[run.first]++;
+    }
+  }
+}
+
 //------------------------------------------------------------------------------
 
 DASamples::DASamples()
@@ -477,15 +1353,38 @@ DASamples::~DASamples()
 }
 
 DASamples::DASamples(const std::vector<DynamicRecord>& bwt)
+{
+  this->build(bwt.size(),
+              [&bwt](size_type i) -> size_type { return bwt[i].size(); },
+              [&bwt](size_type i) -> const PairVector& { return bwt[i].ids; });
+}
+
+DASamples::DASamples(const std::vector<std::shared_ptr<const DynamicRecord>>& bwt)
+{
+  this->build(bwt.size(),
+              [&bwt](size_type i) -> size_type { return bwt[i]->size(); },
+              [&bwt](size_type i) -> const PairVector& { return bwt[i]->ids; });
+}
+
+DASamples::DASamples(const std::vector<size_type>& sizes, const std::vector<std::vector<sample_type>>& samples)
+{
+  this->build(sizes.size(),
+              [&sizes](size_type i) -> size_type { return sizes[i]; },
+              [&samples](size_type i) -> const std::vector<sample_type>& { return samples[i]; });
+}
+
+template<class SizeFunction, class SampleFunction>
+void
+DASamples::build(size_type record_count, SizeFunction record_size, SampleFunction record_samples)
 {
   // Determine the statistics and mark the sampled nodes.
   size_type records = 0, offsets = 0, sample_count = 0;
-  this->sampled_records = sdsl::bit_vector(bwt.size(), 0);
-  for(size_type i = 0; i < bwt.size(); i++)
+  this->sampled_records = sdsl::bit_vector(record_count, 0);
+  for(size_type i = 0; i < record_count; i++)
   {
-    if(bwt[i].samples() > 0)
+    if(!(record_samples(i).empty()))
     {
-      records++; offsets += bwt[i].size(); sample_count += bwt[i].samples();
+      records++; offsets += record_size(i); sample_count += record_samples(i).size();
       this->sampled_records[i] = 1;
     }
   }
@@ -495,17 +1394,17 @@ DASamples::DASamples(const std::vector<DynamicRecord>& bwt)
   sdsl::sd_vector_builder range_builder(offsets, records);
   sdsl::sd_vector_builder offset_builder(offsets, sample_count);
   size_type offset = 0, max_sample = 0;
-  for(const DynamicRecord& record : bwt)
+  for(size_type i = 0; i < record_count; i++)
   {
-    if(record.samples() > 0)
+    if(!(record_samples(i).empty()))
     {
       range_builder.set(offset);
-      for(sample_type sample : record.ids)
+      for(sample_type sample : record_samples(i))
       {
         offset_builder.set(offset + sample.first);
         max_sample = std::max(max_sample, (size_type)(sample.second));
       }
-      offset += record.size();
+      offset += record_size(i);
     }
   }
   this->bwt_ranges = sdsl::sd_vector<>(range_builder);
@@ -516,12 +1415,9 @@ DASamples::DASamples(const std::vector<DynamicRecord>& bwt)
   // Store the samples.
   this->array = sdsl::int_vector<0>(sample_count, 0, bit_length(max_sample));
   size_type curr = 0;
-  for(const DynamicRecord& record : bwt)
+  for(size_type i = 0; i < record_count; i++)
   {
-    if(record.samples() > 0)
-    {
-      for(sample_type sample : record.ids) { this->array[curr] = sample.second; curr++; }
-    }
+    for(sample_type sample : record_samples(i)) { this->array[curr] = sample.second; curr++; }
   }
 }
 
@@ -540,6 +1436,9 @@ DASamples::swap(DASamples& another)
     sdsl::util::swap_support(this->sample_rank, another.sample_rank, &(this->sampled_offsets), &(another.sampled_offsets));
 
     this->array.swap(another.array);
+
+    this->fused_index.swap(another.fused_index);
+    this->fused_samples.swap(another.fused_samples);
   }
 }
 
@@ -566,6 +1465,9 @@ DASamples::operator=(DASamples&& source)
 
     this->array = std::move(source.array);
 
+    this->fused_index = std::move(source.fused_index);
+    this->fused_samples = std::move(source.fused_samples);
+
     this->setVectors();
   }
   return *this;
@@ -605,6 +1507,22 @@ DASamples::load(std::istream& in)
   this->sample_rank.load(in, &(this->sampled_offsets));
 
   this->array.load(in);
+
+  // Build the fused layout if the policy allows it.
+  this->clearFused();
+  if(Acceleration::use(this->fusedBytes())) { this->buildFused(); }
+
+  // Move the arrays accessed in every query to huge pages.
+  if(HugePages::enabled)
+  {
+    HugePages::collapse(this->sampled_records);
+    HugePages::collapse(this->array);
+    if(this->hasFused())
+    {
+      HugePages::collapse(this->fused_index);
+      HugePages::collapse(this->fused_samples);
+    }
+  }
 }
 
 void
@@ -621,6 +1539,9 @@ DASamples::copy(const DASamples& source)
 
   this->array = source.array;
 
+  this->fused_index = source.fused_index;
+  this->fused_samples = source.fused_samples;
+
   this->setVectors();
 }
 
@@ -635,6 +1556,21 @@ DASamples::setVectors()
 size_type
 DASamples::tryLocate(size_type record, size_type offset) const
 {
+  if(this->hasFused())
+  {
+    // Binary search for the offset in the samples of the record.
+    size_type low = this->fused_index[record], high = this->fused_index[record + 1];
+    while(low < high)
+    {
+      size_type mid = low + (high - low) / 2;
+      size_type sample_offset = this->fused_samples[2 * mid];
+      if(sample_offset == offset) { return this->fused_samples[2 * mid + 1]; }
+      if(sample_offset < offset) { low = mid + 1; }
+      else { high = mid; }
+    }
+    return invalid_sequence();
+  }
+
   if(this->sampled_records[record] == 0) { return invalid_sequence(); }
 
   size_type record_start = this->bwt_select(this->record_rank(record) + 1);
@@ -645,6 +1581,76 @@ DASamples::tryLocate(size_type record, size_type offset) const
   return invalid_sequence();
 }
 
+std::vector<std::vector<sample_type>>
+DASamples::decompress() const
+{
+  size_type records = this->sampled_records.size();
+  std::vector<std::vector<sample_type>> result(records);
+
+  sdsl::sd_vector<>::select_1_type offset_select(&(this->sampled_offsets));
+  size_type rank = 0, max_rank = this->record_rank(records);
+  size_type sample = 0;
+  for(size_type record = 0; record < records; record++)
+  {
+    if(this->sampled_records[record] == 0) { continue; }
+    size_type record_start = this->bwt_select(rank + 1);
+    size_type limit = (rank + 1 < max_rank ? this->bwt_select(rank + 2) : this->bwt_ranges.size());
+    while(sample < this->size())
+    {
+      size_type sample_offset = offset_select(sample + 1);
+      if(sample_offset >= limit) { break; }
+      result[record].push_back(sample_type(sample_offset - record_start, this->array[sample]));
+      sample++;
+    }
+    rank++;
+  }
+
+  return result;
+}
+
+size_type
+DASamples::fusedBytes() const
+{
+  size_type records = this->sampled_records.size();
+  size_type width = std::max(bit_length(this->bwt_ranges.size()), (size_type)(this->array.width()));
+  return ((records + 1) * bit_length(this->size()) + 2 * this->size() * width + 7) / 8;
+}
+
+void
+DASamples::buildFused()
+{
+  this->clearFused();
+  size_type records = this->sampled_records.size();
+  if(records == 0 || this->size() == 0) { return; }
+
+  // Offsets within a record are bounded by the total length of the sampled records.
+  size_type width = std::max(bit_length(this->bwt_ranges.size()), (size_type)(this->array.width()));
+  this->fused_index = sdsl::int_vector<0>(records + 1, 0, bit_length(this->size()));
+  this->fused_samples = sdsl::int_vector<0>(2 * this->size(), 0, width);
+
+  std::vector<std::vector<sample_type>> samples = this->decompress();
+  size_type sample = 0;
+  for(size_type record = 0; record < records; record++)
+  {
+    this->fused_index[record] = sample;
+    for(sample_type curr : samples[record])
+    {
+      this->fused_samples[2 * sample] = curr.first;
+      this->fused_samples[2 * sample + 1] = curr.second;
+      sample++;
+    }
+    std::vector<sample_type>().swap(samples[record]);
+  }
+  this->fused_index[records] = sample;
+}
+
+void
+DASamples::clearFused()
+{
+  sdsl::util::clear(this->fused_index);
+  sdsl::util::clear(this->fused_samples);
+}
+
 //------------------------------------------------------------------------------
 
 } // namespace gbwt
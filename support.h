@@ -27,6 +27,9 @@
 
 #include "utils.h"
 
+#include <iterator>
+#include <memory>
+
 namespace gbwt
 {
 
@@ -36,6 +39,169 @@ namespace gbwt
 
 //------------------------------------------------------------------------------
 
+/*
+  Records with at most this many outgoing edges are small. In a small record, edgeTo()
+  scans the edges linearly and the rank computations keep the ranks on the stack.
+*/
+const size_type SMALL_OUTDEGREE = 16;
+
+/*
+  A vector of integer pairs used in the dynamic records. With GBWT_SAVE_MEMORY, the pairs
+  are stored as 32-bit integers until a value does not fit. Then the entire vector is
+  widened to 64-bit integers, so only the records that need the wider values pay for
+  them. The width is stored in the highest bit of the capacity, so the vector is as
+  large as std::vector.
+
+  The elements are returned by value and modified with set().
+*/
+
+class PairVector
+{
+public:
+  typedef gbwt::size_type                 size_type;
+  typedef std::pair<size_type, size_type> value_type;
+
+  class const_iterator
+  {
+  public:
+    typedef std::random_access_iterator_tag iterator_category;
+    typedef PairVector::value_type          value_type;
+    typedef std::ptrdiff_t                  difference_type;
+    typedef value_type                      reference;
+
+    // The element is a temporary, so operator->() returns it through a proxy.
+    struct pointer
+    {
+      value_type value;
+      inline const value_type* operator->() const { return &(this->value); }
+    };
+
+    const_iterator() : source(nullptr), i(0) {}
+    const_iterator(const PairVector& vec, size_type offset) : source(&vec), i(offset) {}
+
+    inline reference operator*() const { return (*(this->source))[this->i]; }
+    inline pointer operator->() const { return pointer { **this }; }
+    inline reference operator[](difference_type n) const { return (*(this->source))[this->i + n]; }
+
+    inline const_iterator& operator++() { this->i++; return *this; }
+    inline const_iterator& operator--() { this->i--; return *this; }
+    inline const_iterator operator++(int) { const_iterator temp = *this; this->i++; return temp; }
+    inline const_iterator operator--(int) { const_iterator temp = *this; this->i--; return temp; }
+    inline const_iterator& operator+=(difference_type n) { this->i += n; return *this; }
+    inline const_iterator& operator-=(difference_type n) { this->i -= n; return *this; }
+    inline const_iterator operator+(difference_type n) const { return const_iterator(*(this->source), this->i + n); }
+    inline const_iterator operator-(difference_type n) const { return const_iterator(*(this->source), this->i - n); }
+    inline difference_type operator-(const_iterator another) const { return this->i - another.i; }
+
+    inline bool operator==(const_iterator another) const { return (this->i == another.i); }
+    inline bool operator!=(const_iterator another) const { return (this->i != another.i); }
+    inline bool operator<(const_iterator another) const { return (this->i < another.i); }
+    inline bool operator>(const_iterator another) const { return (this->i > another.i); }
+    inline bool operator<=(const_iterator another) const { return (this->i <= another.i); }
+    inline bool operator>=(const_iterator another) const { return (this->i >= another.i); }
+
+  private:
+    const PairVector* source;
+    size_type         i;
+  };
+
+  PairVector();
+  PairVector(const PairVector& source);
+  PairVector(PairVector&& source);
+  ~PairVector();
+
+  void swap(PairVector& another);
+  PairVector& operator=(const PairVector& source);
+  PairVector& operator=(PairVector&& source);
+
+  // Replace the contents with the pairs in the vector.
+  void assign(const std::vector<value_type>& source);
+
+  inline size_type size() const { return this->elements; }
+  inline bool empty() const { return (this->size() == 0); }
+  inline size_type capacity() const { return (this->allocated & ~WIDE_FLAG); }
+  inline bool wide() const { return (this->allocated & WIDE_FLAG); }
+
+  inline const_iterator begin() const { return const_iterator(*this, 0); }
+  inline const_iterator end() const { return const_iterator(*this, this->size()); }
+
+  inline value_type operator[](size_type i) const
+  {
+    if(this->wide())
+    {
+      const size_type* ptr = static_cast<const size_type*>(this->data) + 2 * i;
+      return value_type(ptr[0], ptr[1]);
+    }
+    const short_type* ptr = static_cast<const short_type*>(this->data) + 2 * i;
+    return value_type(ptr[0], ptr[1]);
+  }
+
+  inline value_type back() const { return (*this)[this->size() - 1]; }
+
+  inline void set(size_type i, value_type value)
+  {
+    if(!(this->fits(value))) { this->widen(); }
+    this->write(i, value);
+  }
+
+  inline void push_back(value_type value)
+  {
+    if(!(this->fits(value))) { this->widen(); }
+    if(this->size() >= this->capacity()) { this->reserve(std::max(2 * this->capacity(), (size_type)1)); }
+    this->write(this->elements, value);
+    this->elements++;
+  }
+
+  // Insert the value before position i.
+  void insert(size_type i, value_type value);
+
+  // New elements are (0, 0).
+  void resize(size_type n);
+
+  void reserve(size_type n);
+
+  // Keeps the memory and the width.
+  inline void clear() { this->elements = 0; }
+
+  // Switch to 64-bit values.
+  void widen();
+
+private:
+  void*     data;
+  size_type elements;
+  size_type allocated;  // Capacity in elements; the highest bit marks 64-bit values.
+
+  const static size_type WIDE_FLAG = static_cast<size_type>(1) << (WORD_BITS - 1);
+
+  inline bool fits(value_type value) const
+  {
+    return (this->wide() || ((value.first | value.second) >> (sizeof(short_type) * BYTE_BITS)) == 0);
+  }
+
+  inline size_type elementBytes() const
+  {
+    return (this->wide() ? 2 * sizeof(size_type) : 2 * sizeof(short_type));
+  }
+
+  inline void write(size_type i, value_type value)
+  {
+    if(this->wide())
+    {
+      size_type* ptr = static_cast<size_type*>(this->data) + 2 * i;
+      ptr[0] = value.first; ptr[1] = value.second;
+    }
+    else
+    {
+      short_type* ptr = static_cast<short_type*>(this->data) + 2 * i;
+      ptr[0] = value.first; ptr[1] = value.second;
+    }
+  }
+};
+
+std::ostream& operator<<(std::ostream& out, const PairVector& data);
+
+//------------------------------------------------------------------------------
+
 /*
   The part of the BWT corresponding to a single node (the suffixes starting with / the
   prefixes ending with that node).
@@ -49,14 +215,17 @@ struct DynamicRecord
 {
   typedef gbwt::size_type size_type;
 
-  size_type                body_size;
-  std::vector<edge_type>   incoming, outgoing;
-  std::vector<run_type>    body;
-  std::vector<sample_type> ids;
+  size_type  body_size;
+  PairVector incoming, outgoing;  // Edges.
+  PairVector body;                // Runs.
+  PairVector ids;                 // Samples.
+
+  // Are the outgoing edges known to be sorted? Maintained by addOutgoing() and recode().
+  bool       sorted_outgoing;
 
 //------------------------------------------------------------------------------
 
-  DynamicRecord() : body_size(0) {}
+  DynamicRecord() : body_size(0), sorted_outgoing(true) {}
 
   inline size_type size() const { return this->body_size; }
   inline bool empty() const { return (this->size() == 0); }
@@ -87,19 +256,35 @@ struct DynamicRecord
   // Returns BWT[i] within the record.
   node_type operator[](size_type i) const;
 
+  // Returns the number of occurrences in the range with a successor node smaller than 'to'.
+  size_type countSmaller(range_type range, node_type to) const;
+
+  // Returns the offset of the k-th (0-based) occurrence of 'to' or invalid_offset().
+  size_type select(size_type k, node_type to) const;
+
 //------------------------------------------------------------------------------
 
-  // Maps successor nodes to outranks.
+  /*
+    Maps successor nodes to outranks. The outgoing edges are sorted after recode(), but
+    new edges are appended to the end during construction. Binary search is only used
+    when the edges are known to be sorted.
+  */
   rank_type edgeTo(node_type to) const;
 
+  // Add a new outgoing edge to the end.
+  inline void addOutgoing(node_type to)
+  {
+    if(!(this->outgoing.empty()) && to < this->outgoing.back().first) { this->sorted_outgoing = false; }
+    this->outgoing.push_back(edge_type(to, 0));
+  }
+
   // These assume that 'outrank' is a valid outgoing edge.
   inline node_type successor(rank_type outrank) const { return this->outgoing[outrank].first; }
-#ifdef GBWT_SAVE_MEMORY
-  inline short_type& offset(rank_type outrank) { return this->outgoing[outrank].second; }
-#else
-  inline size_type& offset(rank_type outrank) { return this->outgoing[outrank].second; }
-#endif
   inline size_type offset(rank_type outrank) const { return this->outgoing[outrank].second; }
+  inline void setOffset(rank_type outrank, size_type offset)
+  {
+    this->outgoing.set(outrank, edge_type(this->successor(outrank), offset));
+  }
 
 //------------------------------------------------------------------------------
 
@@ -108,12 +293,11 @@ struct DynamicRecord
 
   // These assume that 'inrank' is a valid incoming edge.
   inline node_type predecessor(rank_type inrank) const { return this->incoming[inrank].first; }
-#ifdef GBWT_SAVE_MEMORY
-  inline short_type& count(rank_type inrank) { return this->incoming[inrank].second; }
-#else
-  inline size_type& count(rank_type inrank) { return this->incoming[inrank].second; }
-#endif
   inline size_type count(rank_type inrank) const { return this->incoming[inrank].second; }
+  inline void setCount(rank_type inrank, size_type count)
+  {
+    this->incoming.set(inrank, edge_type(this->predecessor(inrank), count));
+  }
 
   // Increment the count of the incoming edge from 'from'.
   void increment(node_type from);
@@ -137,6 +321,7 @@ struct CompressedRecord
   const byte_type*       body;
   size_type              data_size;
 
+  CompressedRecord(); // Empty record.
   CompressedRecord(const std::vector<byte_type>& source, size_type start, size_type limit);
 
   size_type size() const; // Expensive.
@@ -156,12 +341,76 @@ struct CompressedRecord
   // Returns BWT[i] within the record.
   node_type operator[](size_type i) const;
 
+  // Returns the offset of the k-th (0-based) occurrence of 'to' or invalid_offset().
+  size_type select(size_type k, node_type to) const;
+
+  // Maps successor nodes to outranks.
+  rank_type edgeTo(node_type to) const;
+
+  // These assume that 'outrank' is a valid outgoing edge.
+  inline node_type successor(rank_type outrank) const { return this->outgoing[outrank].first; }
+  inline size_type offset(rank_type outrank) const { return this->outgoing[outrank].second; }
+};
+
+//------------------------------------------------------------------------------
+
+/*
+  A decoded version of a compressed record for fast queries. For each run, we store
+  the starting offset, the outrank, and the number of occurrences of the outrank
+  before the run. The runs are also listed by outrank for rank queries with a given
+  destination. All queries use binary search instead of decoding the body.
+*/
+
+struct DecodedRecord
+{
+  typedef gbwt::size_type size_type;
+
+  std::vector<edge_type> outgoing;
+  std::vector<size_type> run_starts;     // Runs + 1 values.
+  std::vector<rank_type> run_outranks;
+  std::vector<size_type> run_ranks;      // Occurrences of the outrank before the run.
+  std::vector<size_type> outrank_starts; // Outdegree + 1 values.
+  std::vector<size_type> outrank_runs;   // Run identifiers grouped by outrank.
+
+  DecodedRecord();
+  explicit DecodedRecord(const CompressedRecord& record);
+
+  inline size_type size() const { return (this->run_starts.empty() ? 0 : this->run_starts.back()); }
+  inline bool empty() const { return (this->size() == 0); }
+  inline size_type runs() const { return this->run_outranks.size(); }
+  inline size_type outdegree() const { return this->outgoing.size(); }
+
+  // Approximate memory usage.
+  size_type bytes() const;
+
+  // Memory usage of the decoded version of the record.
+  static size_type bytes(size_type outdegree, size_type runs);
+
+  // Returns (node, LF(i, node)) or invalid_edge() if the offset is invalid.
+  edge_type LF(size_type i) const;
+
+  // Returns invalid_offset() if there is no edge to the destination.
+  size_type LF(size_type i, node_type to) const;
+
+  // Returns Range::empty_range() if the range is empty or the destination is invalid.
+  range_type LF(range_type range, node_type to) const;
+
+  // Returns BWT[i] within the record.
+  node_type operator[](size_type i) const;
+
   // Maps successor nodes to outranks.
   rank_type edgeTo(node_type to) const;
 
   // These assume that 'outrank' is a valid outgoing edge.
   inline node_type successor(rank_type outrank) const { return this->outgoing[outrank].first; }
   inline size_type offset(rank_type outrank) const { return this->outgoing[outrank].second; }
+
+private:
+  // Index of the run containing offset i. Assumes that i < size().
+  size_type runAt(size_type i) const;
+
+  // Number of occurrences of 'outrank' in [0, i).
+  size_type rank(size_type i, rank_type outrank) const;
 };
 
 //------------------------------------------------------------------------------
@@ -175,12 +424,19 @@ struct RecordArray
   sdsl::sd_vector<>::select_1_type select;
   std::vector<byte_type>           data;
 
+  // Optional directory of record offsets with records + 1 entries. Not serialized.
+  sdsl::int_vector<0>              directory;
+
   RecordArray();
   RecordArray(const RecordArray& source);
   RecordArray(RecordArray&& source);
   ~RecordArray();
 
   explicit RecordArray(const std::vector<DynamicRecord>& bwt);
+  explicit RecordArray(const std::vector<std::shared_ptr<const DynamicRecord>>& bwt);
+
+  // Concatenates records encoded with encode().
+  explicit RecordArray(const std::vector<std::vector<byte_type>>& records);
 
   void swap(RecordArray& another);
   RecordArray& operator=(const RecordArray& source);
@@ -190,14 +446,138 @@ struct RecordArray
   void load(std::istream& in);
 
   // 0-based indexing.
-  inline size_type start(size_type record) const { return this->select(record + 1); }
+  inline size_type start(size_type record) const
+  {
+    if(this->hasDirectory()) { return this->directory[record]; }
+    return this->select(record + 1);
+  }
+
   inline size_type limit(size_type record) const
   {
+    if(this->hasDirectory()) { return this->directory[record + 1]; }
     return (record + 1 < this->records ? this->select(record + 2) : this->data.size());
   }
 
+  /*
+    The directory replaces two select() queries with two array lookups. load() builds
+    it according to the Acceleration policy.
+  */
+  inline bool hasDirectory() const { return !(this->directory.empty()); }
+  size_type directoryBytes() const; // Size of the directory if it was built.
+  void buildDirectory();
+  void clearDirectory();
+
+  // Appends the encoding of a record with the given outgoing edges and body to the data.
+  static void encode(std::vector<byte_type>& data, const std::vector<edge_type>& outgoing, const std::vector<run_type>& body);
+  static void encode(std::vector<byte_type>& data, const DynamicRecord& record);
+
 private:
   void copy(const RecordArray& source);
+
+  template<class RecordContainer>
+  void build(const RecordContainer& bwt);
+  void buildIndex(const std::vector<size_type>& offsets);
+};
+
+//------------------------------------------------------------------------------
+
+/*
+  Incoming edges of each record, encoded in the same way as the outgoing edges in
+  RecordArray: indegree followed by (gap-encoded predecessor, path count) pairs.
+*/
+
+struct IncomingEdges
+{
+  typedef gbwt::size_type size_type;
+
+  size_type                        records;
+  sdsl::sd_vector<>                index;
+  sdsl::sd_vector<>::select_1_type select;
+  std::vector<byte_type>           data;
+
+  IncomingEdges();
+  IncomingEdges(const IncomingEdges& source);
+  IncomingEdges(IncomingEdges&& source);
+  ~IncomingEdges();
+
+  explicit IncomingEdges(const std::vector<DynamicRecord>& bwt);
+  explicit IncomingEdges(const std::vector<std::shared_ptr<const DynamicRecord>>& bwt);
+  explicit IncomingEdges(const std::vector<std::vector<edge_type>>& incoming);
+
+  void swap(IncomingEdges& another);
+  IncomingEdges& operator=(const IncomingEdges& source);
+  IncomingEdges& operator=(IncomingEdges&& source);
+
+  size_type serialize(std::ostream& out, sdsl::structure_tree_node* v = nullptr, std::string name = "") const;
+  void load(std::istream& in);
+
+  inline bool empty() const { return (this->records == 0); }
+
+  // 0-based indexing.
+  inline size_type start(size_type record) const { return this->select(record + 1); }
+
+  /*
+    Returns (predecessor, offset) for the incoming edge covering offset i of the record,
+    where offset is the first offset in the record reached from the predecessor.
+    Returns invalid_edge() if there is no such edge.
+  */
+  edge_type predecessor(size_type record, size_type i) const;
+
+private:
+  void copy(const IncomingEdges& source);
+
+  template<class RecordContainer>
+  void build(const RecordContainer& bwt);
+};
+
+//------------------------------------------------------------------------------
+
+/*
+  The endmarker record has one position for each sequence, and its outdegree is the
+  number of distinct start nodes. This makes it the largest record and the worst case
+  for both run-length encoding and edgeTo(). EndmarkerIndex is built from the record
+  when loading or constructing the GBWT, and it is not serialized. It stores LF() for
+  each sequence explicitly and the number of sequences starting from each node.
+
+  New sequences are appended to the endmarker record, and the offsets of the existing
+  sequences do not change, so extend() only adds the new sequences. The vectors grow
+  geometrically, and only the first size() values are used.
+*/
+
+struct EndmarkerIndex
+{
+  typedef gbwt::size_type size_type;
+
+  sdsl::int_vector<0>    nodes, offsets;
+  std::vector<edge_type> counts; // (start node, sequences), sorted by node.
+  size_type              sequences;
+
+  EndmarkerIndex();
+
+  explicit EndmarkerIndex(const DynamicRecord& record);
+  explicit EndmarkerIndex(const CompressedRecord& record);
+
+  void swap(EndmarkerIndex& another);
+
+  // Add the last 'new_sequences' sequences of the endmarker record.
+  void extend(const DynamicRecord& record, size_type new_sequences);
+
+  inline size_type size() const { return this->sequences; }
+  inline bool empty() const { return (this->size() == 0); }
+
+  // Returns (start node, offset) for the sequence or invalid_edge() if there is no such sequence.
+  inline edge_type LF(size_type sequence) const
+  {
+    if(sequence >= this->size()) { return invalid_edge(); }
+    return edge_type(this->nodes[sequence], this->offsets[sequence]);
+  }
+
+  // Number of sequences starting from the node.
+  size_type count(node_type node) const;
+
+private:
+  template<class EdgeVector, class RunVector>
+  void build(const EdgeVector& outgoing, const RunVector& body);
 };
 
 //------------------------------------------------------------------------------
@@ -220,12 +600,24 @@ struct DASamples
 
   sdsl::int_vector<0>              array;
 
+  /*
+    Optional fused layout, not serialized. The samples of record i are stored as
+    interleaved (offset, id) pairs in fused_samples[2 * fused_index[i], 2 * fused_index[i + 1]).
+    A lookup touches the index and the pairs instead of the six structures above.
+  */
+  sdsl::int_vector<0>              fused_index;
+  sdsl::int_vector<0>              fused_samples;
+
   DASamples();
   DASamples(const DASamples& source);
   DASamples(DASamples&& source);
   ~DASamples();
 
   explicit DASamples(const std::vector<DynamicRecord>& bwt);
+  explicit DASamples(const std::vector<std::shared_ptr<const DynamicRecord>>& bwt);
+
+  // Builds the samples from record sizes and the samples of each record.
+  DASamples(const std::vector<size_type>& sizes, const std::vector<std::vector<sample_type>>& samples);
 
   void swap(DASamples& another);
   DASamples& operator=(const DASamples& source);
@@ -239,8 +631,20 @@ struct DASamples
   // Returns invalid_sequence() if there is no sample.
   size_type tryLocate(size_type record, size_type offset) const;
 
+  // Returns the samples of each record.
+  std::vector<std::vector<sample_type>> decompress() const;
+
+  // load() builds the fused layout according to the Acceleration policy.
+  inline bool hasFused() const { return !(this->fused_index.empty()); }
+  size_type fusedBytes() const; // Size of the fused layout if it was built.
+  void buildFused();
+  void clearFused();
+
 private:
   void copy(const DASamples& source);
+
+  template<class SizeFunction, class SampleFunction>
+  void build(size_type record_count, SizeFunction record_size, SampleFunction record_samples);
   void setVectors();
 };
 
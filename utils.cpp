@@ -25,6 +25,7 @@
 #include <cstdio>
 #include <cstdlib>
 
+#include <sys/mman.h>
 #include <sys/resource.h>
 #include <unistd.h>
 
@@ -84,6 +85,106 @@ Verbosity::levelName()
 
 //------------------------------------------------------------------------------
 
+size_type Acceleration::policy = Acceleration::DEFAULT;
+
+void
+Acceleration::set(size_type new_policy)
+{
+  policy = Range::bound(new_policy, NEVER, ALWAYS);
+}
+
+std::string
+Acceleration::policyName()
+{
+  switch(policy)
+  {
+    case NEVER:
+      return "never"; break;
+    case AUTO:
+      return "auto"; break;
+    case ALWAYS:
+      return "always"; break;
+  }
+  return "unknown";
+}
+
+bool
+Acceleration::use(size_type bytes)
+{
+  switch(policy)
+  {
+    case NEVER:
+      return false; break;
+    case ALWAYS:
+      return true; break;
+  }
+  return (bytes <= availableMemory() / AUTO_FRACTION);
+}
+
+//------------------------------------------------------------------------------
+
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+#ifndef MADV_COLLAPSE
+#define MADV_COLLAPSE 25
+#endif
+
+bool      HugePages::enabled = false;
+size_type HugePages::prefault_threads = 0;
+
+void
+HugePages::set(bool enable, size_type threads)
+{
+  enabled = enable;
+  prefault_threads = threads;
+}
+
+// Returns the start of the largest range of full huge pages within the memory and sets
+// 'bytes' to its length.
+size_type
+hugePageRange(const void* ptr, size_type& bytes)
+{
+  size_type start = reinterpret_cast<size_type>(ptr), limit = start + bytes;
+  start = (start + HugePages::PAGE_SIZE - 1) & ~(HugePages::PAGE_SIZE - 1);
+  limit &= ~(HugePages::PAGE_SIZE - 1);
+  bytes = (start < limit ? limit - start : 0);
+  return start;
+}
+
+size_type
+HugePages::advise(const void* ptr, size_type bytes)
+{
+  size_type start = hugePageRange(ptr, bytes);
+  if(bytes == 0 || madvise(reinterpret_cast<void*>(start), bytes, MADV_HUGEPAGE) != 0) { return 0; }
+  return bytes;
+}
+
+size_type
+HugePages::collapse(const void* ptr, size_type bytes)
+{
+  size_type start = hugePageRange(ptr, bytes);
+  if(bytes == 0 || madvise(reinterpret_cast<void*>(start), bytes, MADV_HUGEPAGE) != 0) { return 0; }
+  if(madvise(reinterpret_cast<void*>(start), bytes, MADV_COLLAPSE) != 0) { return 0; }
+  return bytes;
+}
+
+void
+HugePages::prefault(const void* ptr, size_type bytes)
+{
+  size_type start = hugePageRange(ptr, bytes);
+  if(prefault_threads == 0 || bytes == 0) { return; }
+
+  size_type pages = bytes / PAGE_SIZE;
+  #pragma omp parallel for num_threads(prefault_threads) schedule(dynamic, 1)
+  for(size_type page = 0; page < pages; page++)
+  {
+    madvise(reinterpret_cast<void*>(start + page * PAGE_SIZE), PAGE_SIZE, MADV_POPULATE_WRITE);
+  }
+}
+
+//------------------------------------------------------------------------------
+
 void
 printHeader(const std::string& header, size_type indent)
 {
@@ -120,6 +221,14 @@ memoryUsage()
 #endif
 }
 
+size_type
+availableMemory()
+{
+  long pages = sysconf(_SC_AVPHYS_PAGES), page_size = sysconf(_SC_PAGESIZE);
+  if(pages < 0 || page_size < 0) { return 0; }
+  return static_cast<size_type>(pages) * static_cast<size_type>(page_size);
+}
+
 //------------------------------------------------------------------------------
 
 std::atomic<size_type> TempFile::counter(0);
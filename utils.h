@@ -28,6 +28,7 @@
 #include <algorithm>
 #include <cstdint>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <vector>
 
@@ -47,8 +48,9 @@ namespace gbwt
 
 /*
   We can save a lot of memory during construction by using 32-bit integers instead of
-  64-bit integers in the dynamic records. This limits the number of nodes and the
-  number of occurrences of each node to less than 2^32.
+  64-bit integers in the dynamic records. With GBWT_SAVE_MEMORY, each vector of pairs in
+  a dynamic record (see PairVector in support.h) starts with 32-bit values and switches
+  to 64-bit values when a value does not fit. Without it, the values are always 64-bit.
 */
 
 #define GBWT_SAVE_MEMORY
@@ -62,15 +64,9 @@ typedef std::uint8_t  byte_type;
 typedef size_type node_type;
 typedef size_type rank_type;  // Rank of incoming / outgoing edge.
 
-#ifdef GBWT_SAVE_MEMORY
-typedef std::pair<short_type, short_type> edge_type;
-typedef std::pair<short_type, short_type> run_type;
-typedef std::pair<short_type, short_type> sample_type;  // (i, DA[i]) within a record
-#else
 typedef std::pair<node_type, size_type>   edge_type;
 typedef std::pair<rank_type, size_type>   run_type;
 typedef std::pair<size_type, size_type>   sample_type;  // (i, DA[i]) within a record
-#endif
 
 //------------------------------------------------------------------------------
 
@@ -193,6 +189,65 @@ struct Verbosity
 
 //------------------------------------------------------------------------------
 
+/*
+  Optional uncompressed structures that are built when a compressed GBWT is loaded.
+  With policy AUTO, a structure is built if it fits in 1 / AUTO_FRACTION of the
+  available memory. Changing the policy only affects GBWTs loaded afterwards.
+*/
+
+struct Acceleration
+{
+  static size_type policy;
+
+  static void set(size_type new_policy);
+  static std::string policyName();
+
+  // Should we build a structure of this many bytes?
+  static bool use(size_type bytes);
+
+  const static size_type NEVER   = 0;
+  const static size_type AUTO    = 1;
+  const static size_type ALWAYS  = 2;
+  const static size_type DEFAULT = 1;
+
+  const static size_type AUTO_FRACTION = 8;
+};
+
+/*
+  Huge page backing for the large arrays of the compressed GBWT. When enabled, load()
+  advises the kernel to use transparent huge pages for the record data before reading
+  it and collapses the already loaded sample arrays into huge pages. The memory can
+  also be prefaulted with several threads before reading. If the kernel does not support
+  an operation, the memory stays in normal pages.
+*/
+
+struct HugePages
+{
+  static bool      enabled;
+  static size_type prefault_threads; // 0 = no prefaulting.
+
+  static void set(bool enable, size_type threads = 0);
+
+  // Use huge pages for memory that has not been touched yet. Returns the advised bytes.
+  static size_type advise(const void* ptr, size_type bytes);
+
+  // Move memory that is already in use to huge pages. Returns the collapsed bytes.
+  static size_type collapse(const void* ptr, size_type bytes);
+
+  template<class VectorType>
+  static size_type collapse(const VectorType& vec)
+  {
+    return collapse(vec.data(), (vec.bit_size() + 7) / 8);
+  }
+
+  // Populate the page tables for the memory using prefault_threads threads.
+  static void prefault(const void* ptr, size_type bytes);
+
+  const static size_type PAGE_SIZE = 2 * 1048576;
+};
+
+//------------------------------------------------------------------------------
+
 template<class IntegerType>
 inline size_type
 bit_length(IntegerType val)
@@ -260,6 +315,7 @@ void printTime(const std::string& header, size_type queries, double seconds, siz
 
 double readTimer();       // Seconds from an arbitrary time point.
 size_type memoryUsage();  // Peak memory usage in bytes.
+size_type availableMemory();  // Available physical memory in bytes.
 
 //------------------------------------------------------------------------------
 
@@ -283,38 +339,97 @@ size_type fileSize(std::ofstream& file);
 //------------------------------------------------------------------------------
 
 /*
-  parallelQuickSort() uses less working space than parallelMergeSort(). Calling omp_set_nested(1)
-  improves the speed of parallelQuickSort().
+  parallelQuickSort() uses less working space than parallelMergeSort(). It is a quicksort
+  using OpenMP tasks: after partitioning, the left part becomes a task that idle threads
+  can pick up, while the current thread continues with the right part. The number of
+  threads is given explicitly with the num_threads clause, so sorting does not change the
+  global OpenMP settings, and concurrent sorts in the same process do not interfere with
+  each other. When called from within an active parallel region, the sort is sequential.
+  After 2 log2(n) levels of partitioning, the remaining ranges are sorted sequentially
+  to avoid quadratic behavior with bad pivots.
+
+  parallelQuickSortThreads() uses at most 'threads' threads, while parallelQuickSort()
+  uses omp_get_max_threads().
 
   Sequential sorting is typically better with less than 1000 elements per thread.
 */
 
+const size_type PARALLEL_SORT_THRESHOLD = 1024;
+
+template<class Iterator, class Comparator>
+void sequentialSort(Iterator first, Iterator last, const Comparator& comp);
+
+template<class Iterator, class Comparator>
+void
+quickSortTask(Iterator first, Iterator last, const Comparator& comp, size_type depth_limit)
+{
+  while(static_cast<size_type>(last - first) > PARALLEL_SORT_THRESHOLD && depth_limit > 0)
+  {
+    // Use the median of three as the pivot.
+    Iterator mid = first + (last - first) / 2, back = last - 1;
+    if(comp(*mid, *first)) { std::iter_swap(mid, first); }
+    if(comp(*back, *mid))
+    {
+      std::iter_swap(back, mid);
+      if(comp(*mid, *first)) { std::iter_swap(mid, first); }
+    }
+    typename std::iterator_traits<Iterator>::value_type pivot = *mid;
+
+    // Hoare partition into [first, right] and [right + 1, last).
+    Iterator left = first, right = back;
+    while(true)
+    {
+      while(comp(*left, pivot)) { ++left; }
+      while(comp(pivot, *right)) { --right; }
+      if(left >= right) { break; }
+      std::iter_swap(left, right); ++left; --right;
+    }
+    Iterator middle = right + 1;
+    depth_limit--;
+
+    #pragma omp task firstprivate(first, middle, depth_limit) shared(comp)
+    quickSortTask(first, middle, comp, depth_limit);
+    first = middle;
+  }
+  sequentialSort(first, last, comp);
+}
+
+template<class Iterator, class Comparator>
+void
+parallelQuickSortThreads(Iterator first, Iterator last, size_type threads, const Comparator& comp)
+{
+  size_type n = last - first;
+  if(threads <= 1 || n <= PARALLEL_SORT_THRESHOLD)
+  {
+    sequentialSort(first, last, comp); return;
+  }
+
+  #pragma omp parallel num_threads(threads)
+  {
+    #pragma omp single
+    quickSortTask(first, last, comp, 2 * (bit_length(n) - 1));
+  }
+}
+
+template<class Iterator>
+void
+parallelQuickSortThreads(Iterator first, Iterator last, size_type threads)
+{
+  parallelQuickSortThreads(first, last, threads, std::less<typename std::iterator_traits<Iterator>::value_type>());
+}
+
 template<class Iterator, class Comparator>
 void
 parallelQuickSort(Iterator first, Iterator last, const Comparator& comp)
 {
-#ifdef _GLIBCXX_PARALLEL
-  int nested = omp_get_nested();
-  omp_set_nested(1);
-  std::sort(first, last, comp, __gnu_parallel::balanced_quicksort_tag());
-  omp_set_nested(nested);
-#else
-  std::sort(first, last, comp);
-#endif
+  parallelQuickSortThreads(first, last, omp_get_max_threads(), comp);
 }
 
 template<class Iterator>
 void
 parallelQuickSort(Iterator first, Iterator last)
 {
-#ifdef _GLIBCXX_PARALLEL
-  int nested = omp_get_nested();
-  omp_set_nested(1);
-  std::sort(first, last, __gnu_parallel::balanced_quicksort_tag());
-  omp_set_nested(nested);
-#else
-  std::sort(first, last);
-#endif
+  parallelQuickSortThreads(first, last, omp_get_max_threads());
 }
 
 template<class Iterator, class Comparator>
@@ -361,32 +476,40 @@ sequentialSort(Iterator first, Iterator last)
 #endif
 }
 
-const size_type PARALLEL_SORT_THRESHOLD = 1024;
+/*
+  Sort with at most 'threads' threads, using one thread for every PARALLEL_SORT_THRESHOLD
+  elements. chooseBestSort() uses at most omp_get_max_threads() threads.
+*/
 
 template<class Iterator, class Comparator>
 void
-chooseBestSort(Iterator first, Iterator last, const Comparator& comp)
+chooseBestSortThreads(Iterator first, Iterator last, size_type threads, const Comparator& comp)
 {
-  size_type old_threads = omp_get_max_threads();
   size_type new_threads = ((last - first) + PARALLEL_SORT_THRESHOLD / 2) / PARALLEL_SORT_THRESHOLD;
+  new_threads = std::min(new_threads, threads);
   if(new_threads <= 1) { sequentialSort(first, last, comp); return; }
+  parallelQuickSortThreads(first, last, new_threads, comp);
+}
 
-  if(new_threads < old_threads) { omp_set_num_threads(new_threads); }
-  parallelQuickSort(first, last, comp);
-  if(new_threads < old_threads) { omp_set_num_threads(old_threads); }
+template<class Iterator>
+void
+chooseBestSortThreads(Iterator first, Iterator last, size_type threads)
+{
+  chooseBestSortThreads(first, last, threads, std::less<typename std::iterator_traits<Iterator>::value_type>());
+}
+
+template<class Iterator, class Comparator>
+void
+chooseBestSort(Iterator first, Iterator last, const Comparator& comp)
+{
+  chooseBestSortThreads(first, last, omp_get_max_threads(), comp);
 }
 
 template<class Iterator>
 void
 chooseBestSort(Iterator first, Iterator last)
 {
-  size_type old_threads = omp_get_max_threads();
-  size_type new_threads = ((last - first) + PARALLEL_SORT_THRESHOLD / 2) / PARALLEL_SORT_THRESHOLD;
-  if(new_threads <= 1) { sequentialSort(first, last); return; }
-
-  if(new_threads < old_threads) { omp_set_num_threads(new_threads); }
-  parallelQuickSort(first, last);
-  if(new_threads < old_threads) { omp_set_num_threads(old_threads); }
+  chooseBestSortThreads(first, last, omp_get_max_threads());
 }
 
 template<class Element>